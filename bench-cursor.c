@@ -0,0 +1,89 @@
+// Find throughput of a _Cursor_H list before and after Compact.
+//
+//     gcc -O3 -march=native bench-cursor.c -o bench-cursor -lm
+//     ./bench-cursor [N] [Scans]
+//
+// The free list is shuffled first, so the N nodes of the list end up all over
+// the cursor space, as they do after a long run of inserts and deletes. Each
+// scan is a Find for a missing key and so walks the whole list.
+#include <time.h>
+
+#define _Cursor_H
+#include "data-structure.c"
+
+static unsigned long Seed = 1;
+
+static unsigned long RandomIndex(unsigned long N)
+{
+    Seed = Seed * 1103515245 + 12345;
+    return ((Seed >> 16) ^ (Seed << 15)) % N;
+}
+
+static double Now(void)
+{
+    struct timespec T;
+    clock_gettime(CLOCK_MONOTONIC, &T);
+    return T.tv_sec + T.tv_nsec * 1e-9;
+}
+
+static double Scan(int Scans, List L, CursorSpace S)
+{
+    double Start = Now();
+    int i;
+
+    for (i = 0; i < Scans; i++)
+        if (Find(-1, L, S) != 0)
+            runtime_error("Found a key that was never inserted");
+    return Now() - Start;
+}
+
+int main(int argc, char *argv[])
+{
+    int N = argc > 1 ? atoi(argv[1]) : 1000000;
+    int Scans = argc > 2 ? atoi(argv[2]) : 50;
+    CursorSpace S = CreateCursorSpace();
+    Position *Nodes, Tmp;
+    List L;
+    int i, j;
+    double Time;
+
+    if (N < 1 || Scans < 1)
+        runtime_error("N and Scans must be positive");
+
+    Nodes = (Position *)Malloc(sizeof(Position) * N);
+    for (i = 0; i < N; i++)
+        Nodes[i] = CursorAlloc(S);
+    for (i = N - 1; i > 0; i--)
+    {
+        j = (int)RandomIndex(i + 1);
+        Tmp = Nodes[i];
+        Nodes[i] = Nodes[j];
+        Nodes[j] = Tmp;
+    }
+    for (i = 0; i < N; i++)
+        CursorFree(Nodes[i], S);
+    Free(Nodes);
+
+    L = Init(S);
+    for (i = 0; i < N; i++)
+        Insert(i, L, Header(L), S);
+    if (Find(N / 2, L, S) == 0)
+        runtime_error("Lost an element");
+
+    printf("%d elements, %d full scans each\n", N, Scans);
+    Time = Scan(Scans, L, S);
+    printf("scattered  %8.3f s  %8.1f Melements/s\n", Time, (double)N * Scans / Time / 1e6);
+
+    Time = Now();
+    Compact(L, S);
+    printf("compact    %8.3f s\n", Now() - Time);
+    if (Find(N / 2, L, S) == 0 || Retrieve(First(L, S), S) != N - 1)
+        runtime_error("Compact changed the list");
+
+    Time = Scan(Scans, L, S);
+    printf("compacted  %8.3f s  %8.1f Melements/s\n", Time, (double)N * Scans / Time / 1e6);
+
+    DeleteList(L, S);
+    DisposeCursorSpace(S);
+    return 0;
+}
@@ -0,0 +1,197 @@
+// Dijkstra on a synthetic road network: a W x H grid with random segment
+// lengths in [1, MaxWeight], like city blocks.
+//
+//     gcc -O2 bench-heap.c -o bench-heap -lm
+//     ./bench-heap [Width] [MaxWeight]
+//
+// Pass 1 runs the full search with _BinHeap_H and _RadixHeap_H on keys packed
+// as Dist << VertexBits | Vertex. Pass 2 replays the distance keys of that run
+// through all three queues, _BucketQueue_H included, because a Dial queue
+// only has MaxWeight + 1 buckets and cannot hold packed keys.
+#include <time.h>
+
+#define _BinHeap_H
+#define ElementType unsigned long long
+#define MinData (0)
+#define InstancePrefix bin
+#include "data-structure-instance.h"
+
+#define _RadixHeap_H
+#define ElementType unsigned long long
+#define InstancePrefix radix
+#include "data-structure-instance.h"
+
+#define _BucketQueue_H
+#define ElementType unsigned long long
+#define InstancePrefix dial
+#include "data-structure-instance.h"
+
+#define VertexBits (24)
+#define VertexMask ((1ull << VertexBits) - 1)
+#define PopOp (~0ull)
+
+struct Graph
+{
+    int NumVertices;
+    int *First;
+    int *Target;
+    int *Weight;
+};
+
+static unsigned long Seed = 1;
+
+static int RandomWeight(int MaxWeight)
+{
+    Seed = Seed * 1103515245 + 12345;
+    return (int)((Seed >> 16) % MaxWeight) + 1;
+}
+
+static double Now(void)
+{
+    struct timespec T;
+    clock_gettime(CLOCK_MONOTONIC, &T);
+    return T.tv_sec + T.tv_nsec * 1e-9;
+}
+
+// both directions of every grid segment, in compressed adjacency form
+static struct Graph BuildGrid(int Width, int MaxWeight)
+{
+    struct Graph G;
+    int N = Width * Width, V, X, Y, E = 0;
+
+    G.NumVertices = N;
+    G.First = (int *)Malloc(sizeof(int) * (N + 1));
+    G.Target = (int *)Malloc(sizeof(int) * 4 * N);
+    G.Weight = (int *)Malloc(sizeof(int) * 4 * N);
+    for (V = 0; V < N; V++)
+    {
+        X = V % Width;
+        Y = V / Width;
+        G.First[V] = E;
+        if (X > 0)
+            G.Target[E++] = V - 1;
+        if (X + 1 < Width)
+            G.Target[E++] = V + 1;
+        if (Y > 0)
+            G.Target[E++] = V - Width;
+        if (Y + 1 < Width)
+            G.Target[E++] = V + Width;
+    }
+    G.First[N] = E;
+    // a segment has the same length both ways
+    for (V = 0; V < N; V++)
+        for (E = G.First[V]; E < G.First[V + 1]; E++)
+            if (G.Target[E] > V)
+                G.Weight[E] = RandomWeight(MaxWeight);
+            else
+            {
+                int R;
+                for (R = G.First[G.Target[E]]; G.Target[R] != V; R++)
+                    ;
+                G.Weight[E] = G.Weight[R];
+            }
+    return G;
+}
+
+// lazy-deletion Dijkstra; Trace gets each inserted distance and PopOp per DeleteMin
+#define Dijkstra(Prefix, Q, G, Dist, Trace, TraceLen)                                     \
+    do                                                                                    \
+    {                                                                                     \
+        int V, E;                                                                         \
+        unsigned long long Key, D;                                                        \
+        for (V = 0; V < (G).NumVertices; V++)                                             \
+            (Dist)[V] = ~0ull;                                                            \
+        (Dist)[0] = 0;                                                                    \
+        Prefix##_Insert(0, Q);                                                            \
+        while (!Prefix##_IsEmpty(Q))                                                      \
+        {                                                                                 \
+            Key = Prefix##_DeleteMin(Q);                                                  \
+            if ((Trace) != NULL)                                                          \
+                (Trace)[(TraceLen)++] = PopOp;                                            \
+            V = (int)(Key & VertexMask);                                                  \
+            if ((Key >> VertexBits) != (Dist)[V])                                         \
+                continue;                                                                 \
+            for (E = (G).First[V]; E < (G).First[V + 1]; E++)                             \
+            {                                                                             \
+                D = (Dist)[V] + (G).Weight[E];                                            \
+                if (D < (Dist)[(G).Target[E]])                                            \
+                {                                                                         \
+                    (Dist)[(G).Target[E]] = D;                                            \
+                    Prefix##_Insert(D << VertexBits | (unsigned long long)(G).Target[E], Q); \
+                    if ((Trace) != NULL)                                                  \
+                        (Trace)[(TraceLen)++] = D;                                        \
+                }                                                                         \
+            }                                                                             \
+        }                                                                                 \
+    } while (0)
+
+#define Replay(Prefix, Q, Trace, TraceLen)          \
+    do                                              \
+    {                                               \
+        long i;                                     \
+        Prefix##_MakeEmpty(Q);                      \
+        Prefix##_Insert(0, Q);                      \
+        for (i = 0; i < (TraceLen); i++)            \
+            if ((Trace)[i] == PopOp)                \
+                Prefix##_DeleteMin(Q);              \
+            else                                    \
+                Prefix##_Insert((Trace)[i], Q);     \
+    } while (0)
+
+int main(int argc, char *argv[])
+{
+    int Width = argc > 1 ? atoi(argv[1]) : 1000;
+    int MaxWeight = argc > 2 ? atoi(argv[2]) : 100;
+    struct Graph G;
+    unsigned long long *Dist, *Check, *Trace;
+    long TraceLen = 0, NoTrace = 0, i;
+    double Start;
+
+    if (Width < 2 || (long)Width * Width > (long)VertexMask || MaxWeight < 1)
+        runtime_error("Width must be in [2, 4095] and MaxWeight at least 1");
+
+    G = BuildGrid(Width, MaxWeight);
+    Dist = (unsigned long long *)Malloc(sizeof(unsigned long long) * G.NumVertices);
+    Check = (unsigned long long *)Malloc(sizeof(unsigned long long) * G.NumVertices);
+    Trace = (unsigned long long *)Malloc(sizeof(unsigned long long) * (2 * (long)G.First[G.NumVertices] + 2));
+    printf("grid %d x %d, %d vertices, %d arcs, weights 1..%d\n",
+           Width, Width, G.NumVertices, G.First[G.NumVertices], MaxWeight);
+
+    bin_PriorityQueue B = bin_Initialize(G.First[G.NumVertices] + 2);
+    radix_PriorityQueue R = radix_Initialize();
+    dial_PriorityQueue Q = dial_Initialize(MaxWeight);
+
+    Start = Now();
+    Dijkstra(bin, B, G, Check, (unsigned long long *)NULL, NoTrace);
+    printf("dijkstra  binary heap  %8.3f s\n", Now() - Start);
+
+    Start = Now();
+    Dijkstra(radix, R, G, Dist, Trace, TraceLen);
+    printf("dijkstra  radix heap   %8.3f s  (traced)\n", Now() - Start);
+
+    for (i = 0; i < G.NumVertices; i++)
+        if (Dist[i] != Check[i])
+            runtime_error("Radix heap and binary heap disagree");
+
+    printf("replay of %ld queue operations:\n", TraceLen + 1);
+    Start = Now();
+    Replay(bin, B, Trace, TraceLen);
+    printf("replay    binary heap  %8.3f s\n", Now() - Start);
+    Start = Now();
+    Replay(radix, R, Trace, TraceLen);
+    printf("replay    radix heap   %8.3f s\n", Now() - Start);
+    Start = Now();
+    Replay(dial, Q, Trace, TraceLen);
+    printf("replay    bucket queue %8.3f s\n", Now() - Start);
+
+    bin_Destroy(B);
+    radix_Destroy(R);
+    dial_Destroy(Q);
+    Free(G.First);
+    Free(G.Target);
+    Free(G.Weight);
+    Free(Dist);
+    Free(Check);
+    Free(Trace);
+    return 0;
+}
@@ -0,0 +1,159 @@
+// Read throughput of a routing-table-like tree, with and without a writer.
+//
+//     gcc -O2 -pthread bench-persistent.c -o bench-persistent -lm
+//     ./bench-persistent [Readers] [Keys] [Seconds]
+//
+// Readers look up random keys; the writer, when present, deletes and
+// reinserts random keys as fast as it can. Compared are _PersistentAvl_H,
+// where a reader only pins an epoch, and _AvlTree_H behind a
+// pthread_rwlock_t, where readers wait whenever the writer holds the lock.
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <time.h>
+
+#define _AvlTree_H
+#define InstancePrefix avl
+#include "data-structure-instance.h"
+
+#define _PersistentAvl_H
+#include "data-structure.c"
+
+struct BenchArgs
+{
+    unsigned int Seed;
+    long Ops;
+};
+
+static atomic_int Stop;
+static int Keys;
+static PersistentAvl Shared;
+static avl_AvlTree Locked;
+static pthread_rwlock_t Lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void *PersistentReader(void *Arg)
+{
+    struct BenchArgs *A = (struct BenchArgs *)Arg;
+    ReaderHandle R = AttachReader(Shared);
+
+    while (!atomic_load_explicit(&Stop, memory_order_relaxed))
+    {
+        if (Find(rand_r(&A->Seed) % Keys, ReadLock(R)) == NULL)
+            runtime_error("Reader saw a missing key");
+        ReadUnlock(R);
+        A->Ops++;
+    }
+    DetachReader(R);
+    return NULL;
+}
+
+static void *PersistentWriter(void *Arg)
+{
+    struct BenchArgs *A = (struct BenchArgs *)Arg;
+    int K;
+
+    while (!atomic_load_explicit(&Stop, memory_order_relaxed))
+    {
+        // keys above the readers' range, so every lookup must still hit
+        K = Keys + rand_r(&A->Seed) % Keys;
+        Insert(K, Shared);
+        Delete(K, Shared);
+        A->Ops += 2;
+    }
+    return NULL;
+}
+
+static void *LockedReader(void *Arg)
+{
+    struct BenchArgs *A = (struct BenchArgs *)Arg;
+    int K;
+
+    while (!atomic_load_explicit(&Stop, memory_order_relaxed))
+    {
+        K = rand_r(&A->Seed) % Keys;
+        pthread_rwlock_rdlock(&Lock);
+        if (avl_Find(K, Locked) == NULL)
+            runtime_error("Reader saw a missing key");
+        pthread_rwlock_unlock(&Lock);
+        A->Ops++;
+    }
+    return NULL;
+}
+
+static void *LockedWriter(void *Arg)
+{
+    struct BenchArgs *A = (struct BenchArgs *)Arg;
+    int K;
+
+    while (!atomic_load_explicit(&Stop, memory_order_relaxed))
+    {
+        K = Keys + rand_r(&A->Seed) % Keys;
+        pthread_rwlock_wrlock(&Lock);
+        Locked = avl_Insert(K, Locked);
+        pthread_rwlock_unlock(&Lock);
+        pthread_rwlock_wrlock(&Lock);
+        Locked = avl_Delete(K, Locked);
+        pthread_rwlock_unlock(&Lock);
+        A->Ops += 2;
+    }
+    return NULL;
+}
+
+static void Run(const char *Name, void *(*Reader)(void *), void *(*Writer)(void *),
+                int Readers, int Seconds)
+{
+    pthread_t *Threads = (pthread_t *)Malloc(sizeof(pthread_t) * (Readers + 1));
+    struct BenchArgs *Args = (struct BenchArgs *)Calloc(Readers + 1, sizeof(struct BenchArgs));
+    long Reads = 0;
+    int i;
+
+    atomic_store(&Stop, 0);
+    for (i = 0; i <= Readers; i++)
+        Args[i].Seed = i + 1;
+    for (i = 0; i < Readers; i++)
+        pthread_create(&Threads[i], NULL, Reader, &Args[i]);
+    if (Writer != NULL)
+        pthread_create(&Threads[Readers], NULL, Writer, &Args[Readers]);
+    sleep(Seconds);
+    atomic_store(&Stop, 1);
+    for (i = 0; i < Readers; i++)
+    {
+        pthread_join(Threads[i], NULL);
+        Reads += Args[i].Ops;
+    }
+    if (Writer != NULL)
+        pthread_join(Threads[Readers], NULL);
+    printf("%-22s %10.2f Mreads/s %10.2f Mupdates/s\n", Name,
+           Reads / (double)Seconds / 1e6, Args[Readers].Ops / (double)Seconds / 1e6);
+    Free(Threads);
+    Free(Args);
+}
+
+int main(int argc, char *argv[])
+{
+    int Readers = argc > 1 ? atoi(argv[1]) : 4;
+    int Seconds = argc > 3 ? atoi(argv[3]) : 2;
+    int i;
+
+    Keys = argc > 2 ? atoi(argv[2]) : 100000;
+    if (Readers < 1 || Keys < 1 || Seconds < 1)
+        runtime_error("Readers, Keys and Seconds must be positive");
+
+    Shared = CreateTree();
+    Locked = NULL;
+    for (i = 0; i < Keys; i++)
+    {
+        Insert(i, Shared);
+        Locked = avl_Insert(i, Locked);
+    }
+    printf("%d readers, %d keys, %d s per run\n", Readers, Keys, Seconds);
+
+    Run("persistent", PersistentReader, NULL, Readers, Seconds);
+    Run("persistent + writer", PersistentReader, PersistentWriter, Readers, Seconds);
+    Run("rwlock avl", LockedReader, NULL, Readers, Seconds);
+    Run("rwlock avl + writer", LockedReader, LockedWriter, Readers, Seconds);
+
+    DisposeTree(Shared);
+    avl_MakeEmpty(Locked);
+    return 0;
+}
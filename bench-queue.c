@@ -0,0 +1,234 @@
+// Hand-off between two pinned threads, for every core pair (0, c).
+//
+//     gcc -O2 -pthread bench-queue.c -o bench-queue -lm
+//     ./bench-queue [Items] [RoundTrips]
+//
+// Throughput: one thread streams Items longs to the other in batches of
+// Batch. Latency: one item bounces between the threads RoundTrips times over
+// a pair of queues. Compared are _Queue_h behind a mutex (what the pipeline
+// used before), _SpscQueue_h and _MpmcQueue_h. Waiting sides sched_yield, so
+// the numbers stay meaningful when both threads share one core.
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+
+#define _Queue_h
+#define ElementType long
+#define InstancePrefix ring
+#include "data-structure-instance.h"
+
+#define _SpscQueue_h
+#define ElementType long
+#define InstancePrefix spsc
+#include "data-structure-instance.h"
+
+#define _MpmcQueue_h
+#define ElementType long
+#define InstancePrefix mpmc
+#include "data-structure-instance.h"
+
+#define Capacity (1024)
+#define Batch (64)
+
+struct LockedQueue
+{
+    pthread_mutex_t Lock;
+    ring_Queue Q;
+};
+typedef struct LockedQueue *Locked;
+
+struct BenchArgs
+{
+    void *Q;
+    void *Reply;
+    long Count;
+    int Cpu;
+    long Sum;
+};
+
+static double Now(void)
+{
+    struct timespec T;
+    clock_gettime(CLOCK_MONOTONIC, &T);
+    return T.tv_sec + T.tv_nsec * 1e-9;
+}
+
+static void Pin(int Cpu)
+{
+    cpu_set_t Set;
+    CPU_ZERO(&Set);
+    CPU_SET(Cpu, &Set);
+    pthread_setaffinity_np(pthread_self(), sizeof(Set), &Set);
+}
+
+static Locked CreateLocked(void)
+{
+    Locked L = (Locked)Malloc(sizeof(struct LockedQueue));
+    pthread_mutex_init(&L->Lock, NULL);
+    L->Q = ring_CreateQueue(Capacity);
+    return L;
+}
+
+static void DisposeLocked(Locked L)
+{
+    ring_DisposeQueue(L->Q);
+    pthread_mutex_destroy(&L->Lock);
+    Free(L);
+}
+
+// the batched calls take the lock once per batch, as the old pipeline did
+static int LockedEnqueueN(const long *X, int N, Locked L)
+{
+    int i;
+    pthread_mutex_lock(&L->Lock);
+    for (i = 0; i < N && !ring_IsFull(L->Q); i++)
+        ring_Enqueue(X[i], L->Q);
+    pthread_mutex_unlock(&L->Lock);
+    return i;
+}
+
+static int LockedDequeueN(long *X, int N, Locked L)
+{
+    int i;
+    pthread_mutex_lock(&L->Lock);
+    for (i = 0; i < N && !ring_IsEmpty(L->Q); i++)
+        X[i] = ring_FrontAndDequeue(L->Q);
+    pthread_mutex_unlock(&L->Lock);
+    return i;
+}
+
+static int LockedTryEnqueue(long X, Locked L)
+{
+    return LockedEnqueueN(&X, 1, L);
+}
+
+static int LockedTryDequeue(long *X, Locked L)
+{
+    return LockedDequeueN(X, 1, L);
+}
+
+// Name##Throughput and Name##Latency for one queue type
+#define DefineBench(Name, QueueType, Create, Dispose, TryEnqueue, TryDequeue, EnqueueN, DequeueN) \
+    static void *Name##Producer(void *Arg)                                                      \
+    {                                                                                           \
+        struct BenchArgs *A = (struct BenchArgs *)Arg;                                          \
+        long Buf[Batch], Sent = 0;                                                              \
+        int i, N, K;                                                                            \
+        Pin(A->Cpu);                                                                            \
+        while (Sent < A->Count)                                                                 \
+        {                                                                                       \
+            N = A->Count - Sent < Batch ? (int)(A->Count - Sent) : Batch;                       \
+            for (i = 0; i < N; i++)                                                             \
+                Buf[i] = Sent + i + 1;                                                          \
+            for (i = 0; i < N; i += K)                                                          \
+                if ((K = EnqueueN(Buf + i, N - i, (QueueType)A->Q)) == 0)                       \
+                    sched_yield();                                                              \
+            Sent += N;                                                                          \
+        }                                                                                       \
+        return NULL;                                                                            \
+    }                                                                                           \
+    static void *Name##Consumer(void *Arg)                                                      \
+    {                                                                                           \
+        struct BenchArgs *A = (struct BenchArgs *)Arg;                                          \
+        long Buf[Batch], Got = 0;                                                               \
+        int i, K;                                                                               \
+        Pin(A->Cpu);                                                                            \
+        while (Got < A->Count)                                                                  \
+        {                                                                                       \
+            if ((K = DequeueN(Buf, Batch, (QueueType)A->Q)) == 0)                               \
+                sched_yield();                                                                  \
+            for (i = 0; i < K; i++)                                                             \
+                A->Sum += Buf[i];                                                               \
+            Got += K;                                                                           \
+        }                                                                                       \
+        return NULL;                                                                            \
+    }                                                                                           \
+    static void *Name##Echo(void *Arg)                                                          \
+    {                                                                                           \
+        struct BenchArgs *A = (struct BenchArgs *)Arg;                                          \
+        long X, i;                                                                              \
+        Pin(A->Cpu);                                                                            \
+        for (i = 0; i < A->Count; i++)                                                          \
+        {                                                                                       \
+            while (!TryDequeue(&X, (QueueType)A->Q))                                            \
+                sched_yield();                                                                  \
+            while (!TryEnqueue(X, (QueueType)A->Reply))                                         \
+                sched_yield();                                                                  \
+        }                                                                                       \
+        return NULL;                                                                            \
+    }                                                                                           \
+    static double Name##Throughput(long Count, int Cpu0, int Cpu1)                              \
+    {                                                                                           \
+        struct BenchArgs P = {NULL, NULL, Count, Cpu0, 0}, C = {NULL, NULL, Count, Cpu1, 0};    \
+        pthread_t T0, T1;                                                                       \
+        double Start;                                                                           \
+        P.Q = C.Q = Create(Capacity);                                                           \
+        Start = Now();                                                                          \
+        pthread_create(&T0, NULL, Name##Producer, &P);                                          \
+        pthread_create(&T1, NULL, Name##Consumer, &C);                                          \
+        pthread_join(T0, NULL);                                                                 \
+        pthread_join(T1, NULL);                                                                 \
+        Start = Now() - Start;                                                                  \
+        if (C.Sum != Count * (Count + 1) / 2)                                                   \
+            runtime_error(#Name " lost or duplicated items");                                   \
+        Dispose((QueueType)P.Q);                                                                \
+        return Count / Start / 1e6;                                                             \
+    }                                                                                           \
+    static double Name##Latency(long Count, int Cpu0, int Cpu1)                                 \
+    {                                                                                           \
+        struct BenchArgs E = {NULL, NULL, Count, Cpu1, 0};                                      \
+        pthread_t T;                                                                            \
+        long X, i;                                                                              \
+        double Start;                                                                           \
+        E.Q = Create(Capacity);                                                                 \
+        E.Reply = Create(Capacity);                                                             \
+        pthread_create(&T, NULL, Name##Echo, &E);                                               \
+        Pin(Cpu0);                                                                              \
+        Start = Now();                                                                          \
+        for (i = 0; i < Count; i++)                                                             \
+        {                                                                                       \
+            while (!TryEnqueue(i, (QueueType)E.Q))                                              \
+                sched_yield();                                                                  \
+            while (!TryDequeue(&X, (QueueType)E.Reply))                                         \
+                sched_yield();                                                                  \
+            if (X != i)                                                                         \
+                runtime_error(#Name " returned the wrong item");                                \
+        }                                                                                       \
+        Start = Now() - Start;                                                                  \
+        pthread_join(T, NULL);                                                                  \
+        Dispose((QueueType)E.Q);                                                                \
+        Dispose((QueueType)E.Reply);                                                            \
+        return Start / Count * 1e9;                                                             \
+    }
+
+#define CreateLockedSized(N) CreateLocked()
+
+DefineBench(Locked, Locked, CreateLockedSized, DisposeLocked, LockedTryEnqueue, LockedTryDequeue, LockedEnqueueN, LockedDequeueN)
+DefineBench(Spsc, spsc_Queue, spsc_CreateQueue, spsc_DisposeQueue, spsc_TryEnqueue, spsc_TryDequeue, spsc_EnqueueN, spsc_DequeueN)
+DefineBench(Mpmc, mpmc_Queue, mpmc_CreateQueue, mpmc_DisposeQueue, mpmc_TryEnqueue, mpmc_TryDequeue, mpmc_EnqueueN, mpmc_DequeueN)
+
+int main(int argc, char *argv[])
+{
+    long Items = argc > 1 ? atol(argv[1]) : 10000000;
+    long RoundTrips = argc > 2 ? atol(argv[2]) : 100000;
+    int NumCpus = (int)sysconf(_SC_NPROCESSORS_ONLN), Cpu;
+
+    if (Items < 1 || RoundTrips < 1)
+        runtime_error("Items and RoundTrips must be positive");
+    printf("%ld items in batches of %d, %ld round trips, queue capacity %d\n",
+           Items, Batch, RoundTrips, Capacity);
+    printf("cpus   queue     Mitems/s   ns/round trip\n");
+    // with a single cpu both threads share it
+    for (Cpu = NumCpus > 1 ? 1 : 0; Cpu < NumCpus; Cpu++)
+    {
+        printf("0,%-3d  mutex   %10.2f %15.0f\n", Cpu,
+               LockedThroughput(Items, 0, Cpu), LockedLatency(RoundTrips, 0, Cpu));
+        printf("0,%-3d  spsc    %10.2f %15.0f\n", Cpu,
+               SpscThroughput(Items, 0, Cpu), SpscLatency(RoundTrips, 0, Cpu));
+        printf("0,%-3d  mpmc    %10.2f %15.0f\n", Cpu,
+               MpmcThroughput(Items, 0, Cpu), MpmcLatency(RoundTrips, 0, Cpu));
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+// Connection-timeout workload: arm N timers with delays up to MaxDelay ticks,
+// cancel half of them, then run the clock until the rest have fired.
+//
+//     gcc -O2 bench-timer.c -o bench-timer -lm
+//     ./bench-timer [N] [MaxDelay]
+//
+// The timing wheel is _TimingWheel_H as is. The binary heap is _BinHeap_H
+// keyed by Expires << IdBits | Id; it cannot remove from the middle, so a
+// cancel only marks the id and DeleteMin skips it later, which is how a heap
+// timer queue is normally run.
+#include <time.h>
+
+#define _BinHeap_H
+#define ElementType unsigned long long
+#define MinData (0)
+#define InstancePrefix bin
+#include "data-structure-instance.h"
+
+#define _TimingWheel_H
+#include "data-structure.c"
+
+#define IdBits (24)
+#define IdMask ((1ull << IdBits) - 1)
+
+static unsigned long Seed = 1;
+static long Expired;
+
+static unsigned long RandomDelay(unsigned long MaxDelay)
+{
+    Seed = Seed * 1103515245 + 12345;
+    return ((Seed >> 16) ^ (Seed << 15)) % MaxDelay + 1;
+}
+
+static double Now(void)
+{
+    struct timespec T;
+    clock_gettime(CLOCK_MONOTONIC, &T);
+    return T.tv_sec + T.tv_nsec * 1e-9;
+}
+
+static void CountExpired(ElementType X)
+{
+    (void)X;
+    Expired++;
+}
+
+int main(int argc, char *argv[])
+{
+    long N = argc > 1 ? atol(argv[1]) : 1000000;
+    unsigned long MaxDelay = argc > 2 ? strtoul(argv[2], NULL, 10) : 60000;
+    unsigned long *Delay, Clock;
+    unsigned long long Key;
+    char *Cancelled;
+    Timer *Handles;
+    long i;
+    double Start, Arm, Cancel, Run;
+
+    if (N < 2 || N > (long)IdMask || MaxDelay < 1 || MaxDelay > MaxTimerDelay)
+        runtime_error("N must be in [2, 2^24) and MaxDelay in [1, MaxTimerDelay]");
+
+    Delay = (unsigned long *)Malloc(sizeof(unsigned long) * N);
+    Cancelled = (char *)Calloc(N, 1);
+    Handles = (Timer *)Malloc(sizeof(Timer) * N);
+    for (i = 0; i < N; i++)
+        Delay[i] = RandomDelay(MaxDelay);
+    printf("%ld timers, delays 1..%lu ticks, every other one cancelled\n", N, MaxDelay);
+
+    TimingWheel W = CreateTimingWheel();
+    Start = Now();
+    for (i = 0; i < N; i++)
+        Handles[i] = AddTimer((int)i, Delay[i], W);
+    Arm = Now() - Start;
+    Start = Now();
+    for (i = 0; i < N; i += 2)
+        CancelTimer(Handles[i], W);
+    Cancel = Now() - Start;
+    Start = Now();
+    Advance(MaxDelay + 1, W, CountExpired);
+    Run = Now() - Start;
+    if (Expired != N / 2 || !IsEmpty(W))
+        runtime_error("Timing wheel lost timers");
+    printf("timing wheel  arm %7.3f s  cancel %7.3f s  expire %7.3f s  total %7.3f s\n",
+           Arm, Cancel, Run, Arm + Cancel + Run);
+    DisposeTimingWheel(W);
+
+    Expired = 0;
+    bin_PriorityQueue H = bin_Initialize(N + 1);
+    Start = Now();
+    for (i = 0; i < N; i++)
+        bin_Insert((unsigned long long)Delay[i] << IdBits | i, H);
+    Arm = Now() - Start;
+    Start = Now();
+    for (i = 0; i < N; i += 2)
+        Cancelled[i] = 1;
+    Cancel = Now() - Start;
+    Start = Now();
+    for (Clock = 0; Clock <= MaxDelay; Clock++)
+        while (!bin_IsEmpty(H) && bin_FindMin(H) >> IdBits <= Clock)
+        {
+            Key = bin_DeleteMin(H);
+            if (!Cancelled[Key & IdMask])
+                CountExpired((ElementType)(Key & IdMask));
+        }
+    Run = Now() - Start;
+    if (Expired != N / 2 || !bin_IsEmpty(H))
+        runtime_error("Binary heap lost timers");
+    printf("binary heap   arm %7.3f s  cancel %7.3f s  expire %7.3f s  total %7.3f s\n",
+           Arm, Cancel, Run, Arm + Cancel + Run);
+    bin_Destroy(H);
+
+    Free(Delay);
+    Free(Cancelled);
+    Free(Handles);
+    return 0;
+}
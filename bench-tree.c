@@ -0,0 +1,163 @@
+// Ordered containers under the same operation streams: _AvlTree_H,
+// _RBTree_H, _Treap_H and _Splay_H.
+//
+//     gcc -O2 bench-tree.c -o bench-tree -lm
+//     ./bench-tree [N] [Ops]
+//
+// sequential  insert 0..N-1 in order into an empty tree
+// insert      insert N random keys into an empty tree
+// read-heavy  Ops operations on that tree, 90% Find and 10% Insert or Delete
+// mixed       Ops operations, half Find and half Insert or Delete
+// delete      delete every remaining key in random order
+//
+// Keys and operations come from a fixed generator, so every tree sees the
+// same stream. Times are in seconds.
+#include <time.h>
+
+#define _AvlTree_H
+#define InstancePrefix avl
+#include "data-structure-instance.h"
+
+#define _RBTree_H
+#define InstancePrefix rb
+#include "data-structure-instance.h"
+
+#define _Treap_H
+#define InstancePrefix treap
+#include "data-structure-instance.h"
+
+#define _Splay_H
+#define InstancePrefix splay
+#include "data-structure-instance.h"
+
+static unsigned long Seed;
+static char *Present;
+static int KeyRange;
+
+static int RandomKey(void)
+{
+    Seed = Seed * 6364136223846793005UL + 1442695040888963407UL;
+    return (int)((Seed >> 33) % KeyRange);
+}
+
+static double Now(void)
+{
+    struct timespec T;
+    clock_gettime(CLOCK_MONOTONIC, &T);
+    return T.tv_sec + T.tv_nsec * 1e-9;
+}
+
+// FindPercent of the Ops are lookups, the rest flip a random key in or out
+#define Operations(Find, Put, Del, Ops, FindPercent)  \
+    do                                                \
+    {                                                 \
+        long i;                                       \
+        int K;                                        \
+        for (i = 0; i < (Ops); i++)                   \
+        {                                             \
+            K = RandomKey();                          \
+            if (RandomKey() % 100 < (FindPercent))    \
+            {                                         \
+                if ((Find(K) != NULL) != Present[K])  \
+                    runtime_error("Find is wrong");   \
+            }                                         \
+            else if (Present[K])                      \
+            {                                         \
+                Del(K);                               \
+                Present[K] = 0;                       \
+            }                                         \
+            else                                      \
+            {                                         \
+                Put(K);                               \
+                Present[K] = 1;                       \
+            }                                         \
+        }                                             \
+    } while (0)
+
+// runs every workload on one container and prints its row
+#define Bench(Name, Create, Find, Put, Del, Dispose, N, Ops)                    \
+    do                                                                          \
+    {                                                                           \
+        double Start, Time[5];                                                  \
+        int i, K;                                                               \
+        Seed = 1;                                                               \
+        memset(Present, 0, KeyRange);                                           \
+        Create;                                                                 \
+        Start = Now();                                                          \
+        for (i = 0; i < (N); i++)                                               \
+            Put(i);                                                             \
+        Time[0] = Now() - Start;                                                \
+        Dispose;                                                                \
+        Create;                                                                 \
+        Start = Now();                                                          \
+        for (i = 0; i < (N); i++)                                               \
+        {                                                                       \
+            K = RandomKey();                                                    \
+            Put(K);                                                             \
+            Present[K] = 1;                                                     \
+        }                                                                       \
+        Time[1] = Now() - Start;                                                \
+        Start = Now();                                                          \
+        Operations(Find, Put, Del, Ops, 90);                                    \
+        Time[2] = Now() - Start;                                                \
+        Start = Now();                                                          \
+        Operations(Find, Put, Del, Ops, 50);                                    \
+        Time[3] = Now() - Start;                                                \
+        Start = Now();                                                          \
+        Seed = 1;                                                               \
+        for (i = 0; i < KeyRange; i++)                                          \
+        {                                                                       \
+            K = RandomKey();                                                    \
+            if (Present[K])                                                     \
+            {                                                                   \
+                Del(K);                                                         \
+                Present[K] = 0;                                                 \
+            }                                                                   \
+        }                                                                       \
+        for (K = 0; K < KeyRange; K++)                                          \
+            if (Present[K])                                                     \
+                Del(K);                                                         \
+        Time[4] = Now() - Start;                                                \
+        Dispose;                                                                \
+        printf("%-8s %10.3f %10.3f %10.3f %10.3f %10.3f\n", Name,             \
+               Time[0], Time[1], Time[2], Time[3], Time[4]);                    \
+    } while (0)
+
+static avl_AvlTree Avl;
+static rb_RBTree Rb;
+static treap_Treap Tp;
+static splay_SplayTree Sp;
+
+#define AvlFind(X) avl_Find(X, Avl)
+#define AvlPut(X) (Avl = avl_Insert(X, Avl))
+#define AvlDel(X) (Avl = avl_Delete(X, Avl))
+#define RbFind(X) rb_Find(X, Rb)
+#define RbPut(X) (Rb = rb_Insert(X, Rb))
+#define RbDel(X) (Rb = rb_Delete(X, Rb))
+#define TreapFind(X) treap_Find(X, Tp)
+#define TreapPut(X) treap_Insert(X, Tp)
+#define TreapDel(X) treap_Delete(X, Tp)
+#define SplayFind(X) splay_Find(X, Sp)
+#define SplayPut(X) splay_Insert(X, Sp)
+#define SplayDel(X) splay_Remove(X, Sp)
+
+int main(int argc, char *argv[])
+{
+    int N = argc > 1 ? atoi(argv[1]) : 1000000;
+    long Ops = argc > 2 ? atol(argv[2]) : 2000000;
+
+    if (N < 1 || Ops < 0 || N > INT_MAX / 4)
+        runtime_error("N must be positive and Ops not negative");
+    KeyRange = 4 * N;
+    Present = (char *)Malloc(KeyRange);
+
+    printf("N = %d, %ld operations per mixed workload, keys in [0, %d)\n", N, Ops, KeyRange);
+    printf("%-8s %10s %10s %10s %10s %10s\n", "tree", "sequential", "insert", "read-heavy", "mixed", "delete");
+    Bench("avl", Avl = NULL, AvlFind, AvlPut, AvlDel, Avl = avl_MakeEmpty(Avl), N, Ops);
+    Bench("rb", Rb = NULL, RbFind, RbPut, RbDel, Rb = rb_MakeEmpty(Rb), N, Ops);
+    Bench("treap", Tp = treap_Initialize(), TreapFind, TreapPut, TreapDel, treap_DisposeTree(Tp), N, Ops);
+    Bench("splay", Sp = splay_Initialize(), SplayFind, SplayPut, SplayDel, splay_DisposeTree(Sp), N, Ops);
+
+    Free(Present);
+    return 0;
+}
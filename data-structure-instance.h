@@ -0,0 +1,341 @@
+// Instantiates one of the sections listed below with every type and function
+// renamed to InstancePrefix_Name, so several element types can live in one
+// translation unit. Include it once per instance:
+//
+//     #define _AvlTree_H
+//     #define ElementType unsigned long long
+//     #define InstancePrefix avl_u64
+//     #include "data-structure-instance.h"
+//
+//     #define _HashSep_H
+//     #define ElementType const char *
+//     #define ElementEqual(A, B) (strcmp(A, B) == 0)
+//     #define ElementHash(S) StringHash(S)
+//     #define InstancePrefix hash_str
+//     #include "data-structure-instance.h"
+//
+// gives avl_u64_AvlTree, avl_u64_Insert, hash_str_HashTable, hash_str_Find...
+// ElementLess, ElementEqual and ElementHash are macros, so comparisons and
+// hashing are expanded in place. Everything defined before the include is
+// undefined again at the end, ready for the next instance.
+
+#ifndef InstancePrefix
+#error "define InstancePrefix before including data-structure-instance.h"
+#endif
+
+// pulled in before the renames so the library headers never see them
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#ifdef _AvlTree_Parallel
+#include <pthread.h>
+#endif
+#if defined(_SpscQueue_h) || defined(_MpmcQueue_h)
+#include <stdatomic.h>
+#endif
+
+#ifndef InstanceName
+#define InstanceJoin(Prefix, Name) Prefix##_##Name
+#define InstanceName(Prefix, Name) InstanceJoin(Prefix, Name)
+#define Instance(Name) InstanceName(InstancePrefix, Name)
+#endif
+
+// types and tags
+#define AvlNode Instance(AvlNode)
+#define AvlTree Instance(AvlTree)
+#define AvlIterator Instance(AvlIterator)
+#define SetOpArgs Instance(SetOpArgs)
+#define Position Instance(Position)
+#define ListNode Instance(ListNode)
+#define List Instance(List)
+#define HashTbl Instance(HashTbl)
+#define HashTable Instance(HashTable)
+#define HashEntry Instance(HashEntry)
+#define Cell Instance(Cell)
+#define Index Instance(Index)
+#define KindOfEntry Instance(KindOfEntry)
+#define Legitimate Instance(Legitimate)
+#define Empty Instance(Empty)
+#define HeapStruct Instance(HeapStruct)
+#define PriorityQueue Instance(PriorityQueue)
+#define RadixBucket Instance(RadixBucket)
+#define RadixHeapStruct Instance(RadixHeapStruct)
+#define Bucket Instance(Bucket)
+#define BucketQueueStruct Instance(BucketQueueStruct)
+#define QueueRecord Instance(QueueRecord)
+#define QueueCell Instance(QueueCell)
+#define Queue Instance(Queue)
+#define RBNode Instance(RBNode)
+#define RBTree Instance(RBTree)
+#define TreapNode Instance(TreapNode)
+#define TreapRecord Instance(TreapRecord)
+#define Treap Instance(Treap)
+#define SplayNode Instance(SplayNode)
+#define SplayBlock Instance(SplayBlock)
+#define SplayTreeRecord Instance(SplayTreeRecord)
+#define SplayTree Instance(SplayTree)
+#define SplayIterator Instance(SplayIterator)
+
+// shared by several sections
+#define NewNode Instance(NewNode)
+#define DeleteNode Instance(DeleteNode)
+#define MakeEmpty Instance(MakeEmpty)
+#define Find Instance(Find)
+#define FindMin Instance(FindMin)
+#define Insert Instance(Insert)
+#define Delete Instance(Delete)
+#define Retrieve Instance(Retrieve)
+#define FindValue Instance(FindValue)
+#define InsertOrAssign Instance(InsertOrAssign)
+#define Upsert Instance(Upsert)
+
+// _AvlTree_H
+#define Max Instance(Max)
+#define SingleRotateWithLeft Instance(SingleRotateWithLeft)
+#define SingleRotateWithRight Instance(SingleRotateWithRight)
+#define DoubleRotateWithLeft Instance(DoubleRotateWithLeft)
+#define DoubleRotateWithRight Instance(DoubleRotateWithRight)
+#define GetHeight Instance(GetHeight)
+#define UpdateHeight Instance(UpdateHeight)
+#define GetSize Instance(GetSize)
+#define UpdateSize Instance(UpdateSize)
+#define CountBelow Instance(CountBelow)
+#define TryRotate Instance(TryRotate)
+#define Rebalance Instance(Rebalance)
+#define InsertNode Instance(InsertNode)
+#define BuildRange Instance(BuildRange)
+#define JoinRight Instance(JoinRight)
+#define JoinLeft Instance(JoinLeft)
+#define DetachMin Instance(DetachMin)
+#define SetOp Instance(SetOp)
+#define SetOpThread Instance(SetOpThread)
+#define FindMax Instance(FindMax)
+#define FindPrev Instance(FindPrev)
+#define FindNext Instance(FindNext)
+#define BuildFromSorted Instance(BuildFromSorted)
+#define JoinNode Instance(JoinNode)
+#define Join Instance(Join)
+#define Split Instance(Split)
+#define Union Instance(Union)
+#define Intersection Instance(Intersection)
+#define Difference Instance(Difference)
+#define IteratorFirst Instance(IteratorFirst)
+#define IteratorSeek Instance(IteratorSeek)
+#define IteratorNext Instance(IteratorNext)
+#define RangeScan Instance(RangeScan)
+#define Rank Instance(Rank)
+#define Select Instance(Select)
+#define CountRange Instance(CountRange)
+
+// _RBTree_H, _Treap_H and _Splay_H, with the _AvlTree_H names above
+#define IsBlack Instance(IsBlack)
+#define RotateLeft Instance(RotateLeft)
+#define RotateRight Instance(RotateRight)
+#define InsertFixup Instance(InsertFixup)
+#define DeleteFixup Instance(DeleteFixup)
+#define RandomPriority Instance(RandomPriority)
+#define SetSeed Instance(SetSeed)
+#define DisposeTree Instance(DisposeTree)
+#define Splay Instance(Splay)
+#define SplayDue Instance(SplayDue)
+#define SetSplayPeriod Instance(SetSplayPeriod)
+#define Remove Instance(Remove)
+#define IteratorPush Instance(IteratorPush)
+#define PushLeft Instance(PushLeft)
+#define IteratorDispose Instance(IteratorDispose)
+
+// _HashSep_H and _HashQuad_H
+#define ConvertToString Instance(ConvertToString)
+#define Hash Instance(Hash)
+#define IsPrime Instance(IsPrime)
+#define NextPrime Instance(NextPrime)
+#define InitializeTable Instance(InitializeTable)
+#define DestroyList Instance(DestroyList)
+#define DestroyTable Instance(DestroyTable)
+#define Rehash Instance(Rehash)
+
+// _BinHeap_H
+#define Initialize Instance(Initialize)
+#define Destroy Instance(Destroy)
+#define DeleteMin Instance(DeleteMin)
+#define IsEmpty Instance(IsEmpty)
+#define IsFull Instance(IsFull)
+
+// _RadixHeap_H and _BucketQueue_H, with the _BinHeap_H names above
+#define PushBucket Instance(PushBucket)
+#define BucketIndex Instance(BucketIndex)
+#define Refill Instance(Refill)
+
+// _Queue_h, _SpscQueue_h and _MpmcQueue_h
+#define CreateQueue Instance(CreateQueue)
+#define DisposeQueue Instance(DisposeQueue)
+#define Succ Instance(Succ)
+#define Enqueue Instance(Enqueue)
+#define Front Instance(Front)
+#define Dequeue Instance(Dequeue)
+#define FrontAndDequeue Instance(FrontAndDequeue)
+#define RoundUpPowerOfTwo Instance(RoundUpPowerOfTwo)
+#define TryEnqueue Instance(TryEnqueue)
+#define TryDequeue Instance(TryDequeue)
+#define EnqueueN Instance(EnqueueN)
+#define DequeueN Instance(DequeueN)
+
+#include "data-structure.c"
+
+#undef AvlNode
+#undef AvlTree
+#undef AvlIterator
+#undef SetOpArgs
+#undef Position
+#undef ListNode
+#undef List
+#undef HashTbl
+#undef HashTable
+#undef HashEntry
+#undef Cell
+#undef Index
+#undef KindOfEntry
+#undef Legitimate
+#undef Empty
+#undef HeapStruct
+#undef PriorityQueue
+#undef RadixBucket
+#undef RadixHeapStruct
+#undef Bucket
+#undef BucketQueueStruct
+#undef QueueRecord
+#undef QueueCell
+#undef Queue
+#undef RBNode
+#undef RBTree
+#undef TreapNode
+#undef TreapRecord
+#undef Treap
+#undef SplayNode
+#undef SplayBlock
+#undef SplayTreeRecord
+#undef SplayTree
+#undef SplayIterator
+
+#undef NewNode
+#undef DeleteNode
+#undef MakeEmpty
+#undef Find
+#undef FindMin
+#undef Insert
+#undef Delete
+#undef Retrieve
+#undef FindValue
+#undef InsertOrAssign
+#undef Upsert
+
+#undef Max
+#undef SingleRotateWithLeft
+#undef SingleRotateWithRight
+#undef DoubleRotateWithLeft
+#undef DoubleRotateWithRight
+#undef GetHeight
+#undef UpdateHeight
+#undef GetSize
+#undef UpdateSize
+#undef CountBelow
+#undef TryRotate
+#undef Rebalance
+#undef InsertNode
+#undef BuildRange
+#undef JoinRight
+#undef JoinLeft
+#undef DetachMin
+#undef SetOp
+#undef SetOpThread
+#undef FindMax
+#undef FindPrev
+#undef FindNext
+#undef BuildFromSorted
+#undef JoinNode
+#undef Join
+#undef Split
+#undef Union
+#undef Intersection
+#undef Difference
+#undef IteratorFirst
+#undef IteratorSeek
+#undef IteratorNext
+#undef RangeScan
+#undef Rank
+#undef Select
+#undef CountRange
+
+#undef IsBlack
+#undef RotateLeft
+#undef RotateRight
+#undef InsertFixup
+#undef DeleteFixup
+#undef RandomPriority
+#undef SetSeed
+#undef DisposeTree
+#undef Splay
+#undef SplayDue
+#undef SetSplayPeriod
+#undef Remove
+#undef IteratorPush
+#undef PushLeft
+#undef IteratorDispose
+
+#undef ConvertToString
+#undef Hash
+#undef IsPrime
+#undef NextPrime
+#undef InitializeTable
+#undef DestroyList
+#undef DestroyTable
+#undef Rehash
+
+#undef Initialize
+#undef Destroy
+#undef DeleteMin
+#undef IsEmpty
+#undef IsFull
+
+#undef PushBucket
+#undef BucketIndex
+#undef Refill
+
+#undef CreateQueue
+#undef DisposeQueue
+#undef Succ
+#undef Enqueue
+#undef Front
+#undef Dequeue
+#undef FrontAndDequeue
+#undef RoundUpPowerOfTwo
+#undef TryEnqueue
+#undef TryDequeue
+#undef EnqueueN
+#undef DequeueN
+
+// the instance's parameters, so the next one starts from the defaults
+#undef InstancePrefix
+#undef ElementType
+#undef ElementLess
+#undef ElementEqual
+#undef ElementHash
+#undef ValueType
+#undef MinData
+#undef _AvlTree_H
+#undef _AvlTree_Size
+#undef _AvlTree_Parallel
+#undef _RBTree_H
+#undef _Treap_H
+#undef _Splay_H
+#undef _HashSep_H
+#undef _HashQuad_H
+#undef _BinHeap_H
+#undef _RadixHeap_H
+#undef _BucketQueue_H
+#undef _Queue_h
+#undef _SpscQueue_h
+#undef _MpmcQueue_h
@@ -1,5 +1,9 @@
 #include "data-structure.h"
 
+// data-structure-instance.h includes this file once per instance
+#ifndef _DataStructure_C
+#define _DataStructure_C
+
 void unix_error(char *msg)
 {
     fprintf(stderr, "%s %s\n", msg, strerror(errno));
@@ -39,6 +43,8 @@ void Free(void *ptr)
     free(ptr);
 }
 
+#endif
+
 #ifdef _List_H
 
 static void DeleteNode(Position P)
@@ -157,6 +163,78 @@ ElementType Retrieve(Position P)
 
 #endif
 
+#ifdef _IntrusiveList_H
+
+List Init(struct ListLink *L)
+{
+    L->Next = NULL;
+    return L;
+}
+
+int IsEmpty(List L)
+{
+    return L->Next == NULL;
+}
+
+int IsLast(Position P, List L)
+{
+    (void)L;
+    return P->Next == NULL;
+}
+
+Position FindPrevious(Position N, List L)
+{
+    Position P = L;
+    while (P->Next != NULL && P->Next != N)
+        P = P->Next;
+    return P;
+}
+
+// links N after P
+void Insert(Position N, List L, Position P)
+{
+    (void)L;
+    N->Next = P->Next;
+    P->Next = N;
+}
+
+// unlinks and returns the link after P
+Position RemoveAfter(Position P)
+{
+    Position N = P->Next;
+    if (N != NULL)
+    {
+        P->Next = N->Next;
+        N->Next = NULL;
+    }
+    return N;
+}
+
+void Remove(Position N, List L)
+{
+    Position P = FindPrevious(N, L);
+    if (P->Next != N)
+        runtime_error("Can not find the element in the list");
+    RemoveAfter(P);
+}
+
+Position Header(List L)
+{
+    return L;
+}
+
+Position First(List L)
+{
+    return L->Next;
+}
+
+Position Advance(Position P)
+{
+    return P->Next;
+}
+
+#endif
+
 #ifdef _DoubleList_H
 
 static void DeleteNode(Position P)
@@ -265,810 +343,5248 @@ ElementType Retrieve(Position P)
 
 #endif
 
-#ifdef _Cursor_H
+#ifdef _IntrusiveDoubleList_H
 
-void InitializeCursorSpace(void)
+List Init(struct DoubleLink *L)
 {
-    int i;
-    for (i = 0; i < SpaceSize; i++)
-        CursorSpace[i].Next = i + 1;
-    CursorSpace[SpaceSize].Next = 0;
-    return;
+    L->Prev = L->Next = L;
+    return L;
 }
 
-Position CursorAlloc(void)
+int IsEmpty(List L)
 {
-    Position P;
-    P = CursorSpace[0].Next;
-    CursorSpace[0].Next = CursorSpace[P].Next;
-    if (P == 0)
-        runtime_error("Out of space!!!");
-    return P;
+    return L->Next == L;
 }
 
-void CursorFree(Position P)
+int IsLast(Position P, List L)
 {
-    CursorSpace[P].Next = CursorSpace[0].Next;
-    CursorSpace[0].Next = P;
+    return P->Next == L;
 }
 
-static void DeleteNode(Position P)
+int IsLinked(Position P)
 {
-    CursorFree(P);
+    return P->Next != NULL;
 }
 
-static Position NewNode(ElementType X, Position PNext)
+// links N before P, Insert(N, L, Header(L)) appends
+void Insert(Position N, List L, Position P)
 {
-    Position P = CursorAlloc();
-    CursorSpace[P].Element = X;
-    CursorSpace[P].Next = PNext;
-    return P;
+    (void)L;
+    N->Prev = P->Prev;
+    N->Next = P;
+    P->Prev->Next = N;
+    P->Prev = N;
 }
 
-List MakeEmpty(List L)
+void Remove(Position P)
 {
-    Position P, TmpCell;
-    P = CursorSpace[L].Next;
-    while (P != 0)
-    {
-        TmpCell = CursorSpace[P].Next;
-        DeleteNode(P);
-        P = TmpCell;
-    }
-    return L;
+    P->Prev->Next = P->Next;
+    P->Next->Prev = P->Prev;
+    P->Prev = P->Next = NULL;
 }
 
-int IsEmpty(List L)
+Position Header(List L)
 {
-    return CursorSpace[L].Next == 0;
+    return L;
 }
 
-int IsLast(Position P, List L)
+// First and Last return the header on an empty list
+Position First(List L)
 {
-    return CursorSpace[P].Next == 0;
+    return L->Next;
 }
 
-Position Find(ElementType X, List L)
+Position Last(List L)
 {
-    Position P;
+    return L->Prev;
+}
 
-    P = CursorSpace[L].Next;
-    while (P && CursorSpace[P].Element != X)
-        P = CursorSpace[P].Next;
-    return P;
+Position Prev(Position P)
+{
+    return P->Prev;
 }
 
-void Delete(ElementType X, List L)
+Position Next(Position P)
 {
-    Position P, TmpCell;
-    P = FindPrevious(X, L);
-    if (!IsLast(P, L))
-    {
-        TmpCell = CursorSpace[P].Next;
-        CursorSpace[P].Next = CursorSpace[TmpCell].Next;
-        DeleteNode(TmpCell);
-    }
+    return P->Next;
 }
 
-Position FindPrevious(ElementType X, const List L)
+#endif
+
+#ifdef _XorList_H
+
+static PtrToNode NewNode(ElementType X, List L)
 {
-    Position P;
-    P = L;
-    while (CursorSpace[P].Next != 0 && CursorSpace[P].Element != X)
-        P = CursorSpace[P].Next;
+    PtrToNode P;
+    if (L->FreeList != 0)
+    {
+        P = L->FreeList;
+        L->FreeList = L->Nodes[P].Link;
+    }
+    else
+    {
+        if (L->Top == L->Capacity)
+        {
+            if (L->Capacity > (PtrToNode)-1 / 2)
+                runtime_error("Out of space!!!");
+            L->Capacity *= 2;
+            L->Nodes = (struct Node *)Realloc(L->Nodes, sizeof(struct Node) * L->Capacity);
+        }
+        P = L->Top++;
+    }
+    L->Nodes[P].Element = X;
     return P;
 }
 
-void Insert(ElementType X, List L, Position P)
+static void DeleteNode(PtrToNode P, List L)
 {
-    Position TmpCell;
-    TmpCell = NewNode(X, CursorSpace[P].Next);
-    CursorSpace[P].Next = TmpCell;
+    L->Nodes[P].Link = L->FreeList;
+    L->FreeList = P;
 }
 
-void DeleteList(List L)
+List Init()
 {
-    Position P, TmpCell;
-    P = CursorSpace[L].Next;
-    DeleteNode(L);
-    while (P != 0)
-    {
-        TmpCell = CursorSpace[P].Next;
-        DeleteNode(P);
-        P = TmpCell;
-    }
+    List L;
+    L = (List)Malloc(sizeof(struct ListRecord));
+    L->Capacity = MinXorPoolSize;
+    L->Nodes = (struct Node *)Malloc(sizeof(struct Node) * L->Capacity);
+    return MakeEmpty(L);
 }
 
-Position Header(const List L)
+// keeps the pool
+List MakeEmpty(List L)
 {
+    L->Nodes[0].Element = 0;
+    L->Nodes[0].Link = 0;
+    L->Top = 1;
+    L->FreeList = 0;
+    L->Last = 0;
     return L;
 }
 
-Position First(const List L)
+int IsEmpty(List L)
 {
-    return CursorSpace[L].Next;
+    return L->Last == 0;
 }
 
-Position Advance(const Position P)
+int IsLast(Position P, List L)
 {
-    return CursorSpace[P].Next;
+    return P.Cur == L->Last;
 }
 
-ElementType Retrieve(const Position P)
+// Cur is 0 if X is not in the list
+Position Find(ElementType X, List L)
 {
-    return CursorSpace[P].Element;
+    Position P = First(L);
+    while (P.Cur != 0 && L->Nodes[P.Cur].Element != X)
+        P = Next(P, L);
+    return P;
 }
 
-#endif
-
-#ifdef _Stack_h
+void Delete(ElementType X, List L)
+{
+    Position P = Find(X, L);
+    if (P.Cur == 0)
+        runtime_error("Can not find the element in the list");
+    DeleteAt(P, L);
+}
 
-static PtrToNode NewNode(ElementType X, PtrToNode PNext)
+// returns the position that followed P
+Position DeleteAt(Position P, List L)
 {
-    PtrToNode P = (PtrToNode)Malloc(sizeof(struct Node));
-    P->Element = X;
-    P->Next = PNext;
+    PtrToNode A = P.Prev, B = P.Cur, C;
+
+    C = L->Nodes[B].Link ^ A;
+    L->Nodes[A].Link ^= B ^ C;
+    L->Nodes[C].Link ^= B ^ A;
+    if (B == L->Last)
+        L->Last = A;
+    DeleteNode(B, L);
+    P.Cur = C;
     return P;
 }
 
-static void DeleteNode(PtrToNode P)
+Position FindPrevious(ElementType X, List L)
 {
-    Free(P);
+    return Prev(Find(X, L), L);
 }
 
-int IsEmpty(Stack S)
+// inserts before P and returns the new node's position, P itself is stale afterwards
+Position Insert(ElementType X, List L, Position P)
 {
-    return S->Next == NULL;
+    PtrToNode A = P.Prev, B = P.Cur, N;
+
+    N = NewNode(X, L);
+    L->Nodes[N].Link = A ^ B;
+    L->Nodes[A].Link ^= B ^ N;
+    L->Nodes[B].Link ^= A ^ N;
+    if (B == 0)
+        L->Last = N;
+    P.Cur = N;
+    return P;
 }
 
-Stack CreateStack(void)
+void DeleteList(List L)
 {
-    Stack S;
-    S = NewNode(0, NULL);
-    MakeEmpty(S);
-    return S;
+    Free(L->Nodes);
+    Free(L);
 }
 
-void DisposeStack(Stack S)
+Position Header(List L)
 {
-    MakeEmpty(S);
-    DeleteNode(S);
+    Position P;
+    P.Prev = L->Last;
+    P.Cur = 0;
+    return P;
 }
 
-void MakeEmpty(Stack S)
+Position First(List L)
 {
-    if (S == NULL)
-        runtime_error("Must use CreateStack first");
-    else
-        while (!IsEmpty(S))
-            Pop(S);
+    return Next(Header(L), L);
 }
 
-void Push(ElementType X, Stack S)
+Position Prev(Position P, List L)
 {
-    PtrToNode TmpCell;
-    TmpCell = NewNode(X, S->Next);
-    S->Next = TmpCell;
-    return;
+    Position Q;
+    Q.Prev = L->Nodes[P.Prev].Link ^ P.Cur;
+    Q.Cur = P.Prev;
+    return Q;
 }
 
-ElementType Top(Stack S)
+Position Next(Position P, List L)
 {
-    if (!IsEmpty(S))
-        return S->Next->Element;
-    runtime_error("Empty Stack");
-    return 0;
+    Position Q;
+    Q.Prev = P.Cur;
+    Q.Cur = L->Nodes[P.Cur].Link ^ P.Prev;
+    return Q;
 }
 
-void Pop(Stack S)
+ElementType Retrieve(Position P, List L)
 {
-    PtrToNode TmpCell = S->Next;
-    if (TmpCell == NULL)
-        runtime_error("Empty Stack");
-    S->Next = TmpCell->Next;
-    DeleteNode(TmpCell);
+    return L->Nodes[P.Cur].Element;
 }
 
 #endif
 
-#ifdef _Stack_H
+#ifdef _UnrolledList_H
 
-int IsEmpty(Stack S)
+static PtrToNode NewNode(PtrToNode PPrev, PtrToNode PNext, List L)
 {
-    return S->TopOfStack == EmptyTOS;
+    PtrToNode P = (PtrToNode)Malloc(sizeof(struct Node));
+    P->Count = 0;
+    P->Prev = PPrev;
+    P->Next = PNext;
+    if (PPrev != NULL)
+        PPrev->Next = P;
+    if (PNext != NULL)
+        PNext->Prev = P;
+    else
+        L->Tail = P;
+    return P;
 }
 
-int IsFull(Stack S)
+static void DeleteNode(PtrToNode P, List L)
 {
-    return S->TopOfStack >= S->Capacity - 1;
+    if (P->Prev != NULL)
+        P->Prev->Next = P->Next;
+    if (P->Next != NULL)
+        P->Next->Prev = P->Prev;
+    else
+        L->Tail = P->Prev;
+    Free(P);
 }
 
-Stack CreateStack(int MaxElements)
+// the first loop has no early exit so it compiles to packed compares
+static int FindInNode(ElementType X, PtrToNode P)
 {
-    Stack S;
-    if (MaxElements < MinStackSize)
-        runtime_error("Stack size if too small");
-    S = Malloc(sizeof(struct StackRecord));
-    S->Array = (ElementType *)Malloc(sizeof(ElementType) * MaxElements);
-    S->Capacity = MaxElements;
-    MakeEmpty(S);
-    return S;
+    int i, Hit = 0;
+
+    for (i = 0; i < P->Count; i++)
+        Hit |= (P->Elements[i] == X);
+    if (!Hit)
+        return -1;
+    for (i = 0; P->Elements[i] != X; i++)
+        ;
+    return i;
 }
 
-void DisposeStack(Stack S)
+// only the head may be empty, and only when the whole list is
+static void RemoveAt(PtrToNode P, int Index, List L)
 {
-    if (S != NULL)
+    PtrToNode PN = P->Next;
+
+    memmove(&P->Elements[Index], &P->Elements[Index + 1], sizeof(ElementType) * (P->Count - Index - 1));
+    P->Count--;
+
+    if (PN != NULL && (P->Count == 0 || P->Count + PN->Count <= (int)UnrolledNodeSize / 2))
     {
-        free(S->Array);
-        free(S);
+        memcpy(&P->Elements[P->Count], PN->Elements, sizeof(ElementType) * PN->Count);
+        P->Count += PN->Count;
+        DeleteNode(PN, L);
     }
+    else if (P->Count == 0 && P != L->Head)
+        DeleteNode(P, L);
 }
 
-void MakeEmpty(Stack S)
+List Init()
 {
-    S->TopOfStack = EmptyTOS;
+    List L;
+    L = (List)Malloc(sizeof(struct ListRecord));
+    L->Head = NewNode(NULL, NULL, L);
+    return L;
 }
 
-void Push(ElementType X, Stack S)
+List MakeEmpty(List L)
 {
-    if (IsFull(S))
-        runtime_error("Full Stack");
-    else
-        S->Array[++S->TopOfStack] = X;
+    while (L->Head->Next != NULL)
+        DeleteNode(L->Head->Next, L);
+    L->Head->Count = 0;
+    return L;
 }
 
-ElementType Top(Stack S)
+int IsEmpty(List L)
 {
-    if (!IsEmpty(S))
-        return S->Array[S->TopOfStack];
-    runtime_error("Empty Stack");
-    return 0;
+    return L->Head->Count == 0;
 }
 
-void Pop(Stack S)
+int IsLast(Position P, List L)
 {
-    if (IsEmpty(S))
-        runtime_error("Empty Stack");
-    else
-        S->TopOfStack--;
+    return P.Node == L->Tail && P.Index == P.Node->Count - 1;
 }
 
-ElementType TopAndPop(Stack S)
+Position Find(ElementType X, List L)
 {
-    if (!IsEmpty(S))
-        return S->Array[S->TopOfStack--];
-    runtime_error("Empty Stack");
-    return 0;
-}
-
-#endif
+    Position P;
+    PtrToNode N;
+    int i = -1;
 
-#ifdef _Queue_h
+    for (N = L->Head; N != NULL; N = N->Next)
+        if ((i = FindInNode(X, N)) >= 0)
+            break;
+    P.Node = N;
+    P.Index = N != NULL ? i : 0;
+    return P;
+}
 
-int IsEmpty(Queue Q)
+void Delete(ElementType X, List L)
 {
-    return Q->Size == 0;
+    Position P = Find(X, L);
+    if (P.Node != NULL)
+        RemoveAt(P.Node, P.Index, L);
 }
 
-int IsFull(Queue Q)
+Position FindPrevious(ElementType X, List L)
 {
-    return Q->Capacity == Q->Size;
+    Position P = Find(X, L);
+    if (P.Node == NULL)
+        return P;
+    return Prev(P);
 }
 
-Queue CreateQueue(int MaxElements)
+// inserts after P, splitting a full node in half first
+void Insert(ElementType X, List L, Position P)
 {
-    Queue Q;
-    if (MaxElements < MinQueueSize)
-        runtime_error("Queue size if too small");
-    Q = (Queue)Malloc(sizeof(struct QueueRecord));
-    Q->Array = (ElementType *)Malloc(sizeof(ElementType) * MaxElements);
-    Q->Capacity = MaxElements;
-    MakeEmpty(Q);
-    return Q;
+    PtrToNode N = P.Node, M;
+    int i = P.Index + 1, Half;
+
+    if (N == NULL)
+        runtime_error("Invalid position");
+    if (N->Count == (int)UnrolledNodeSize)
+    {
+        Half = N->Count / 2;
+        M = NewNode(N, N->Next, L);
+        memcpy(M->Elements, &N->Elements[Half], sizeof(ElementType) * (N->Count - Half));
+        M->Count = N->Count - Half;
+        N->Count = Half;
+        if (i > Half)
+        {
+            N = M;
+            i -= Half;
+        }
+    }
+    memmove(&N->Elements[i + 1], &N->Elements[i], sizeof(ElementType) * (N->Count - i));
+    N->Elements[i] = X;
+    N->Count++;
 }
 
-void DisposeQueue(Queue Q)
+void DeleteList(List L)
 {
-    if (Q != NULL)
+    PtrToNode P = L->Head, PN;
+    while (P != NULL)
     {
-        Free(Q->Array);
-        Free(Q);
+        PN = P->Next;
+        Free(P);
+        P = PN;
     }
+    Free(L);
 }
 
-void MakeEmpty(Queue Q)
+Position Header(List L)
 {
-    Q->Front = 0;
-    Q->Rear = -1;
-    Q->Size = 0;
-    return;
+    Position P;
+    P.Node = L->Head;
+    P.Index = -1;
+    return P;
 }
 
-static int Succ(int Value, Queue Q)
+Position First(List L)
 {
-    if (++Value == Q->Capacity)
-        Value = 0;
-    return Value;
+    Position P;
+    P.Node = IsEmpty(L) ? NULL : L->Head;
+    P.Index = 0;
+    return P;
 }
 
-void Enqueue(ElementType X, Queue Q)
+Position Advance(Position P)
 {
-    if (IsFull(Q))
-        runtime_error("Full queue");
-    else
+    if (++P.Index >= P.Node->Count)
     {
-        Q->Size++;
-        Q->Rear = Succ(Q->Rear, Q);
-        Q->Array[Q->Rear] = X;
+        P.Node = P.Node->Next;
+        P.Index = 0;
     }
+    return P;
 }
 
-ElementType Front(Queue Q)
-{
-    if (IsEmpty(Q))
-        runtime_error("Empty queue");
-    return Q->Array[Q->Front];
-}
-
-void Dequeue(Queue Q)
+Position Prev(Position P)
 {
-    if (IsEmpty(Q))
-        runtime_error("Empty queue");
-    else
+    if (P.Index > 0 || (P.Index == 0 && P.Node->Prev == NULL))
+        P.Index--;
+    else if (P.Index == 0)
     {
-        Q->Size--;
-        Q->Front = Succ(Q->Front, Q);
+        P.Node = P.Node->Prev;
+        P.Index = P.Node->Count - 1;
     }
+    else
+        P.Node = NULL;
+    return P;
 }
 
-ElementType FrontAndDequeue(Queue Q)
+ElementType Retrieve(Position P)
 {
-    ElementType X = Front(Q);
-    Dequeue(Q);
-    return X;
+    if (P.Node == NULL || P.Index < 0)
+        return 0;
+    return P.Node->Elements[P.Index];
 }
 
 #endif
 
-#ifdef _Queue_H
+#ifdef _SkipList_H
 
-PtrToNode NewNode(ElementType X, PtrToNode PNext)
+static Position NewNode(ElementType X, int Level)
 {
-    PtrToNode P;
-    P = (PtrToNode)Malloc(sizeof(struct Node));
+    Position P;
+    int i;
+    P = (Position)Malloc(sizeof(struct Node) + sizeof(Position) * Level);
     P->Element = X;
-    P->Next = PNext;
+    P->Level = Level;
+    for (i = 0; i < Level; i++)
+        P->Next[i] = NULL;
     return P;
 }
 
-void DeleteNode(PtrToNode P)
+static void DeleteNode(Position P)
 {
     Free(P);
 }
 
-int IsEmpty(Queue Q)
+// same minimal standard generator as _Random_H, kept per list
+static int RandomLevel(SkipList L)
 {
-    return Q->Size == 0; // or Q->Front==NULL && Q->Rear==NULL;
-}
+    long TmpSeed;
+    int Level = 1;
 
-Queue CreateQueue()
-{
-    Queue Q;
-    Q = (Queue)Malloc(sizeof(struct QueueRecord));
-    Q->Front = NULL;
-    Q->Rear = NULL;
-    Q->Size = 0;
-    return Q;
+    for (;;)
+    {
+        TmpSeed = RandomA * (L->Seed % RandomQ) - RandomR * (L->Seed / RandomQ);
+        L->Seed = TmpSeed >= 0 ? TmpSeed : TmpSeed + RandomM;
+        if (Level == MaxLevel || L->Seed % 4 != 0)
+            return Level;
+        Level++;
+    }
 }
 
-void DisposeQueue(Queue Q)
+// returns the last node before X on level 0; Update[i] gets the one on level i
+static Position FindLess(ElementType X, SkipList L, Position Update[])
 {
-    PtrToNode P;
-    P = Q->Front;
-    while (P != NULL)
+    Position P = L->Head;
+    int i;
+
+    for (i = L->Level - 1; i >= 0; i--)
     {
-        PtrToNode PN = P->Next;
-        DeleteNode(P);
-        P = PN;
+        while (P->Next[i] != NULL && P->Next[i]->Element < X)
+            P = P->Next[i];
+        if (Update != NULL)
+            Update[i] = P;
     }
-    Free(Q);
+    return P;
 }
 
-void MakeEmpty(Queue Q)
+SkipList Init(void)
 {
-    PtrToNode P;
-    P = Q->Front;
+    SkipList L;
+    L = (SkipList)Malloc(sizeof(struct SkipListRecord));
+    L->Head = NewNode(0, MaxLevel);
+    L->Level = 1;
+    L->Seed = 1;
+    return L;
+}
+
+// 0 is a fixed point of the generator and would give every node MaxLevel
+void SetSeed(unsigned long InitVal, SkipList L)
+{
+    L->Seed = InitVal % RandomM;
+    if (L->Seed == 0)
+        L->Seed = 1;
+}
+
+SkipList MakeEmpty(SkipList L)
+{
+    Position P = L->Head->Next[0], Tmp;
+    int i;
+
     while (P != NULL)
     {
-        PtrToNode PN = P->Next;
+        Tmp = P->Next[0];
         DeleteNode(P);
-        P = PN;
+        P = Tmp;
     }
-    Q->Front = NULL;
-    Q->Rear = NULL;
-    Q->Size = 0;
+    for (i = 0; i < MaxLevel; i++)
+        L->Head->Next[i] = NULL;
+    L->Level = 1;
+    return L;
 }
 
-void Enqueue(ElementType X, Queue Q)
+void DeleteList(SkipList L)
 {
-    PtrToNode P = NewNode(X, NULL);
-    if (IsEmpty(Q))
-        Q->Front = Q->Rear = P;
-    else
-    {
-        Q->Rear->Next = P;
-        Q->Rear = P;
-    }
-    Q->Size++;
+    MakeEmpty(L);
+    DeleteNode(L->Head);
+    Free(L);
 }
 
-ElementType Front(Queue Q)
+int IsEmpty(SkipList L)
 {
-    if (IsEmpty(Q))
-        runtime_error("Empty queue");
-    return Q->Front->Element;
+    return L->Head->Next[0] == NULL;
 }
 
-void Dequeue(Queue Q)
+Position Find(ElementType X, SkipList L)
 {
-    if (IsEmpty(Q))
-        runtime_error("Empty queue");
-    else
-    {
-        PtrToNode P;
-        Q->Size--;
-        P = Q->Front;
-        Q->Front = Q->Front->Next;
-        DeleteNode(P);
-    }
-    if (IsEmpty(Q))
-        Q->Front = Q->Rear = NULL;
+    Position P = FindLess(X, L, NULL)->Next[0];
+    if (P != NULL && P->Element == X)
+        return P;
+    return NULL;
 }
 
-ElementType FrontAndDequeue(Queue Q)
+Position Seek(ElementType X, SkipList L)
 {
-    ElementType X = Front(Q);
-    Dequeue(Q);
-    return X;
+    return FindLess(X, L, NULL)->Next[0];
 }
 
-#endif
+void Insert(ElementType X, SkipList L)
+{
+    Position Update[MaxLevel];
+    Position P;
+    int i, Level;
 
-#ifdef _Deque_h
+    P = FindLess(X, L, Update)->Next[0];
+    if (P != NULL && P->Element == X)
+        return;
 
-int IsEmpty(Deque D)
-{
-    return D->Size == 0;
+    Level = RandomLevel(L);
+    for (i = L->Level; i < Level; i++)
+        Update[i] = L->Head;
+    if (Level > L->Level)
+        L->Level = Level;
+
+    P = NewNode(X, Level);
+    for (i = 0; i < Level; i++)
+    {
+        P->Next[i] = Update[i]->Next[i];
+        Update[i]->Next[i] = P;
+    }
 }
 
-int IsFull(Deque D)
+void Delete(ElementType X, SkipList L)
 {
-    return D->Size == D->Capacity;
+    Position Update[MaxLevel];
+    Position P;
+    int i;
+
+    P = FindLess(X, L, Update)->Next[0];
+    if (P == NULL || P->Element != X)
+        return;
+
+    for (i = 0; i < P->Level; i++)
+        Update[i]->Next[i] = P->Next[i];
+    while (L->Level > 1 && L->Head->Next[L->Level - 1] == NULL)
+        L->Level--;
+    DeleteNode(P);
 }
 
-Deque CreateDeque(int MaxElemnts)
+Position First(SkipList L)
 {
-    Deque D;
-    if (MaxElemnts < MinDequeSize)
-        runtime_error("Deque size if too small");
-    D = (Deque)Malloc(sizeof(struct DequeRecord));
-    D->Array = (ElementType *)Malloc(sizeof(ElementType) * MaxElemnts);
-    D->Capacity = MaxElemnts;
-    MakeEmpty(D);
-    return D;
+    return L->Head->Next[0];
 }
 
-void DisposeDeque(Deque D)
+Position Advance(Position P)
 {
-    if (D != NULL)
-    {
-        Free(D->Array);
-        Free(D);
-    }
+    return P->Next[0];
 }
 
-void MakeEmpty(Deque D)
+ElementType Retrieve(Position P)
 {
-    D->Size = 0;
-    D->Front = 0;
-    D->Rear = -1;
+    return P->Element;
 }
 
-static int Succ(int Value, Deque D)
+#endif
+
+#ifdef _ConcurrentSkipList_H
+
+static Position NewNode(ElementType X, int Level)
 {
-    if (++Value == D->Capacity)
-        Value = 0;
-    return Value;
+    Position P;
+    int i;
+    P = (Position)Malloc(sizeof(struct Node) + sizeof(_Atomic(Position)) * Level);
+    P->Element = X;
+    P->Level = Level;
+    P->Retired = NULL;
+    for (i = 0; i < Level; i++)
+        atomic_init(&P->Next[i], NULL);
+    return P;
 }
 
-static int Prev(int Value, Deque D)
+static void DeleteNode(Position P)
 {
-    if (--Value == -1)
-        Value = D->Capacity - 1;
-    return Value;
+    Free(P);
 }
 
-void Push(ElementType X, Deque D)
+static int RandomLevel(SkipList L)
 {
-    if (IsFull(D))
-        runtime_error("Full deque");
-    else if (IsEmpty(D))
-        Inject(X, D);
-    else
+    long TmpSeed;
+    int Level = 1;
+
+    for (;;)
     {
-        D->Size++;
-        D->Front = Prev(D->Front, D);
-        D->Array[D->Front] = X;
+        TmpSeed = RandomA * (L->Seed % RandomQ) - RandomR * (L->Seed / RandomQ);
+        L->Seed = TmpSeed >= 0 ? TmpSeed : TmpSeed + RandomM;
+        if (Level == MaxLevel || L->Seed % 4 != 0)
+            return Level;
+        Level++;
     }
 }
 
-void Pop(Deque D)
+static Position FindLess(ElementType X, SkipList L, Position Update[])
 {
-    if (IsEmpty(D))
-        runtime_error("Empty deque");
-    else
+    Position P = L->Head, PN;
+    int i;
+
+    for (i = atomic_load_explicit(&L->Level, memory_order_acquire) - 1; i >= 0; i--)
     {
-        D->Size--;
-        D->Front = Succ(D->Front, D);
+        while ((PN = atomic_load_explicit(&P->Next[i], memory_order_acquire)) != NULL && PN->Element < X)
+            P = PN;
+        if (Update != NULL)
+            Update[i] = P;
     }
+    return P;
 }
 
-void Inject(ElementType X, Deque D)
+// waits until every reader that could still see a retired node has left
+static void Synchronize(SkipList L)
 {
-    if (IsFull(D))
-        runtime_error("Full deque");
-    else
+    Position P, PN;
+    int i, Phase;
+
+    for (i = 0; i < 2; i++)
+    {
+        Phase = atomic_load(&L->Phase);
+        atomic_store(&L->Phase, !Phase);
+        while (atomic_load(&L->Readers[Phase]) != 0)
+            sched_yield();
+    }
+    for (P = L->Retired; P != NULL; P = PN)
     {
-        D->Size++;
-        D->Rear = Succ(D->Rear, D);
-        D->Array[D->Rear] = X;
+        PN = P->Retired;
+        DeleteNode(P);
     }
+    L->Retired = NULL;
+    L->NumRetired = 0;
+}
+
+SkipList Init(void)
+{
+    SkipList L;
+    L = (SkipList)Malloc(sizeof(struct SkipListRecord));
+    L->Head = NewNode(0, MaxLevel);
+    atomic_init(&L->Level, 1);
+    L->Seed = 1;
+    pthread_mutex_init(&L->WriteLock, NULL);
+    atomic_init(&L->Phase, 0);
+    atomic_init(&L->Readers[0], 0);
+    atomic_init(&L->Readers[1], 0);
+    L->Retired = NULL;
+    L->NumRetired = 0;
+    return L;
 }
 
-void Eject(Deque D)
+void SetSeed(unsigned long InitVal, SkipList L)
 {
-    if (IsEmpty(D))
-        runtime_error("Empty deque");
-    else
+    pthread_mutex_lock(&L->WriteLock);
+    L->Seed = InitVal % RandomM;
+    if (L->Seed == 0)
+        L->Seed = 1;
+    pthread_mutex_unlock(&L->WriteLock);
+}
+
+// no other thread may use the list any more
+void DeleteList(SkipList L)
+{
+    Position P, PN;
+
+    Synchronize(L);
+    for (P = L->Head; P != NULL; P = PN)
     {
-        D->Size--;
-        D->Rear = Prev(D->Rear, D);
+        PN = atomic_load_explicit(&P->Next[0], memory_order_relaxed);
+        DeleteNode(P);
     }
+    pthread_mutex_destroy(&L->WriteLock);
+    Free(L);
 }
 
-ElementType Front(Deque D)
+int IsEmpty(SkipList L)
 {
-    if (IsEmpty(D))
-        runtime_error("Empty deque");
-    return D->Array[D->Front];
+    return atomic_load_explicit(&L->Head->Next[0], memory_order_acquire) == NULL;
 }
 
-ElementType Rear(Deque D)
+int ReadLock(SkipList L)
 {
-    if (IsEmpty(D))
-        runtime_error("Empty deque");
-    return D->Array[D->Rear];
+    int Phase = atomic_load(&L->Phase);
+    atomic_fetch_add(&L->Readers[Phase], 1);
+    return Phase;
 }
 
-ElementType FrontAndPop(Deque D)
+void ReadUnlock(int Phase, SkipList L)
 {
-    if (IsEmpty(D))
-        runtime_error("Empty deque");
-    ElementType X = Front(D);
-    Pop(D);
-    return X;
+    atomic_fetch_sub_explicit(&L->Readers[Phase], 1, memory_order_release);
 }
 
-ElementType RearAndEject(Deque D)
+Position Find(ElementType X, SkipList L)
 {
-    if (IsEmpty(D))
-        runtime_error("Empty deque");
-    ElementType X = Rear(D);
-    Eject(D);
-    return X;
+    Position P = atomic_load_explicit(&FindLess(X, L, NULL)->Next[0], memory_order_acquire);
+    if (P != NULL && P->Element == X)
+        return P;
+    return NULL;
 }
 
-#endif
-
-#ifdef _Tree_H
+Position Seek(ElementType X, SkipList L)
+{
+    return atomic_load_explicit(&FindLess(X, L, NULL)->Next[0], memory_order_acquire);
+}
 
-static SearchTree NewNode(ElementType X, SearchTree Left, SearchTree Right)
+// links bottom-up so a reader never reaches a level whose lower links are unset
+void Insert(ElementType X, SkipList L)
 {
-    SearchTree T = (SearchTree)Malloc(sizeof(struct TreeNode));
-    T->Element = X;
+    Position Update[MaxLevel];
+    Position P;
+    int i, Level, OldLevel;
+
+    pthread_mutex_lock(&L->WriteLock);
+    P = atomic_load_explicit(&FindLess(X, L, Update)->Next[0], memory_order_relaxed);
+    if (P == NULL || P->Element != X)
+    {
+        Level = RandomLevel(L);
+        OldLevel = atomic_load_explicit(&L->Level, memory_order_relaxed);
+        for (i = OldLevel; i < Level; i++)
+            Update[i] = L->Head;
+
+        P = NewNode(X, Level);
+        for (i = 0; i < Level; i++)
+        {
+            atomic_store_explicit(&P->Next[i], atomic_load_explicit(&Update[i]->Next[i], memory_order_relaxed),
+                                  memory_order_relaxed);
+            atomic_store_explicit(&Update[i]->Next[i], P, memory_order_release);
+        }
+        if (Level > OldLevel)
+            atomic_store_explicit(&L->Level, Level, memory_order_release);
+    }
+    pthread_mutex_unlock(&L->WriteLock);
+}
+
+// unlinks top-down; the node is freed only after a grace period
+void Delete(ElementType X, SkipList L)
+{
+    Position Update[MaxLevel];
+    Position P;
+    int i;
+
+    pthread_mutex_lock(&L->WriteLock);
+    P = atomic_load_explicit(&FindLess(X, L, Update)->Next[0], memory_order_relaxed);
+    if (P != NULL && P->Element == X)
+    {
+        for (i = P->Level - 1; i >= 0; i--)
+            atomic_store_explicit(&Update[i]->Next[i],
+                                  atomic_load_explicit(&P->Next[i], memory_order_relaxed),
+                                  memory_order_release);
+        P->Retired = L->Retired;
+        L->Retired = P;
+        if (++L->NumRetired >= MaxRetired)
+            Synchronize(L);
+    }
+    pthread_mutex_unlock(&L->WriteLock);
+}
+
+void Reclaim(SkipList L)
+{
+    pthread_mutex_lock(&L->WriteLock);
+    Synchronize(L);
+    pthread_mutex_unlock(&L->WriteLock);
+}
+
+Position First(SkipList L)
+{
+    return atomic_load_explicit(&L->Head->Next[0], memory_order_acquire);
+}
+
+Position Advance(Position P)
+{
+    return atomic_load_explicit(&P->Next[0], memory_order_acquire);
+}
+
+ElementType Retrieve(Position P)
+{
+    return P->Element;
+}
+
+#endif
+
+#ifdef _LockFreeList_H
+
+static Position NewNode(ElementType X, Position PNext)
+{
+    Position P = (Position)Malloc(sizeof(struct Node));
+    P->Element = X;
+    atomic_init(&P->Next, (uintptr_t)PNext);
+    P->Retired = NULL;
+    return P;
+}
+
+static void DeleteNode(Position P)
+{
+    Free(P);
+}
+
+static void FreeLimbo(ThreadHandle R, int i)
+{
+    Position P, PN;
+    for (P = R->Limbo[i]; P != NULL; P = PN)
+    {
+        PN = P->Retired;
+        DeleteNode(P);
+    }
+    R->Limbo[i] = NULL;
+}
+
+// State is (epoch << 1) | 1 while the thread is inside an operation
+static void Enter(List L, ThreadHandle R)
+{
+    unsigned int Epoch = atomic_load(&L->GlobalEpoch);
+    int i;
+
+    atomic_store(&R->State, (Epoch << 1) | 1);
+    for (i = 0; i < 3; i++)
+        if (R->Limbo[i] != NULL && R->LimboEpoch[i] + 2 <= Epoch)
+            FreeLimbo(R, i);
+}
+
+static void Leave(ThreadHandle R)
+{
+    atomic_store_explicit(&R->State, 0, memory_order_release);
+}
+
+static void TryAdvance(List L)
+{
+    unsigned int Epoch = atomic_load(&L->GlobalEpoch), State;
+    ThreadHandle R;
+
+    for (R = atomic_load_explicit(&L->Records, memory_order_acquire); R != NULL; R = R->Next)
+    {
+        State = atomic_load(&R->State);
+        if ((State & 1) && (State >> 1) != Epoch)
+            return;
+    }
+    atomic_compare_exchange_strong(&L->GlobalEpoch, &Epoch, Epoch + 1);
+}
+
+// a node unlinked during epoch E is freed once the global epoch reaches E + 2
+static void Retire(Position P, List L, ThreadHandle R)
+{
+    unsigned int Epoch = atomic_load(&L->GlobalEpoch);
+    int i = Epoch % 3;
+
+    if (R->Limbo[i] != NULL && R->LimboEpoch[i] != Epoch)
+        FreeLimbo(R, i);
+    R->LimboEpoch[i] = Epoch;
+    P->Retired = R->Limbo[i];
+    R->Limbo[i] = P;
+    if (++R->NumRetired >= AdvanceThreshold)
+    {
+        R->NumRetired = 0;
+        TryAdvance(L);
+    }
+}
+
+// finds the first unmarked node not less than X, unlinking marked nodes on the way
+static int Search(ElementType X, List L, ThreadHandle R, _Atomic(uintptr_t) **PrevLink, Position *Cur)
+{
+    _Atomic(uintptr_t) *Prev;
+    Position P;
+    uintptr_t Next, Expected;
+
+Retry:
+    Prev = &L->Head->Next;
+    P = Unmark(atomic_load(Prev));
+    while (P != NULL)
+    {
+        Next = atomic_load(&P->Next);
+        if (IsMarked(Next))
+        {
+            Expected = (uintptr_t)P;
+            if (!atomic_compare_exchange_strong(Prev, &Expected, (uintptr_t)Unmark(Next)))
+                goto Retry;
+            Retire(P, L, R);
+            P = Unmark(Next);
+            continue;
+        }
+        if (!(P->Element < X))
+            break;
+        Prev = &P->Next;
+        P = Unmark(Next);
+    }
+    *PrevLink = Prev;
+    *Cur = P;
+    return P != NULL && P->Element == X;
+}
+
+List Init(void)
+{
+    List L;
+    L = (List)Malloc(sizeof(struct ListRecord));
+    L->Head = NewNode(0, NULL);
+    atomic_init(&L->GlobalEpoch, 0);
+    atomic_init(&L->Records, NULL);
+    return L;
+}
+
+// no other thread may use the list any more
+void DeleteList(List L)
+{
+    Position P, PN;
+    ThreadHandle R, RN;
+    int i;
+
+    for (P = L->Head; P != NULL; P = PN)
+    {
+        PN = Unmark(atomic_load(&P->Next));
+        DeleteNode(P);
+    }
+    for (R = atomic_load(&L->Records); R != NULL; R = RN)
+    {
+        RN = R->Next;
+        for (i = 0; i < 3; i++)
+            FreeLimbo(R, i);
+        Free(R);
+    }
+    Free(L);
+}
+
+ThreadHandle AttachThread(List L)
+{
+    ThreadHandle R, Head;
+    int i, Expected;
+
+    for (R = atomic_load_explicit(&L->Records, memory_order_acquire); R != NULL; R = R->Next)
+    {
+        Expected = 0;
+        if (atomic_compare_exchange_strong(&R->InUse, &Expected, 1))
+            return R;
+    }
+
+    R = (ThreadHandle)Malloc(sizeof(struct ThreadRecord));
+    atomic_init(&R->State, 0);
+    atomic_init(&R->InUse, 1);
+    for (i = 0; i < 3; i++)
+    {
+        R->Limbo[i] = NULL;
+        R->LimboEpoch[i] = 0;
+    }
+    R->NumRetired = 0;
+    Head = atomic_load_explicit(&L->Records, memory_order_relaxed);
+    do
+        R->Next = Head;
+    while (!atomic_compare_exchange_weak_explicit(&L->Records, &Head, R,
+                                                  memory_order_release, memory_order_relaxed));
+    return R;
+}
+
+void DetachThread(ThreadHandle R)
+{
+    atomic_store(&R->State, 0);
+    atomic_store(&R->InUse, 0);
+}
+
+int IsEmpty(List L)
+{
+    return Unmark(atomic_load(&L->Head->Next)) == NULL;
+}
+
+// wait-free: never helps, never retries, a marked node simply counts as absent
+int Find(ElementType X, List L, ThreadHandle R)
+{
+    Position P;
+    int Found;
+
+    Enter(L, R);
+    P = Unmark(atomic_load(&L->Head->Next));
+    while (P != NULL && P->Element < X)
+        P = Unmark(atomic_load(&P->Next));
+    Found = P != NULL && P->Element == X && !IsMarked(atomic_load(&P->Next));
+    Leave(R);
+    return Found;
+}
+
+int Insert(ElementType X, List L, ThreadHandle R)
+{
+    _Atomic(uintptr_t) *Prev;
+    Position Cur, P = NULL;
+    uintptr_t Expected;
+    int Done = 0;
+
+    Enter(L, R);
+    while (!Search(X, L, R, &Prev, &Cur))
+    {
+        if (P == NULL)
+            P = NewNode(X, Cur);
+        else
+            atomic_store_explicit(&P->Next, (uintptr_t)Cur, memory_order_relaxed);
+        Expected = (uintptr_t)Cur;
+        if (atomic_compare_exchange_strong(Prev, &Expected, (uintptr_t)P))
+        {
+            Done = 1;
+            break;
+        }
+    }
+    Leave(R);
+    if (!Done && P != NULL)
+        DeleteNode(P);
+    return Done;
+}
+
+int Delete(ElementType X, List L, ThreadHandle R)
+{
+    _Atomic(uintptr_t) *Prev;
+    Position Cur;
+    uintptr_t Next, Expected;
+    int Done = 0;
+
+    Enter(L, R);
+    while (Search(X, L, R, &Prev, &Cur))
+    {
+        Next = atomic_load(&Cur->Next);
+        if (IsMarked(Next))
+            continue;
+        if (!atomic_compare_exchange_strong(&Cur->Next, &Next, Next | 1))
+            continue;
+        Done = 1;
+        Expected = (uintptr_t)Cur;
+        if (atomic_compare_exchange_strong(Prev, &Expected, Next))
+            Retire(Cur, L, R);
+        else
+            Search(X, L, R, &Prev, &Cur);
+        break;
+    }
+    Leave(R);
+    return Done;
+}
+
+#endif
+
+#ifdef _Cursor_H
+
+static void AddChunk(CursorSpace S)
+{
+    if (S->NumChunks == MaxCursorChunks)
+        runtime_error("Out of space!!!");
+    if (S->NumChunks == S->MaxChunks)
+    {
+        S->MaxChunks = S->MaxChunks * 2 < MaxCursorChunks ? S->MaxChunks * 2 : MaxCursorChunks;
+        S->Chunks = (struct CursorChunk **)Realloc(S->Chunks, sizeof(struct CursorChunk *) * S->MaxChunks);
+    }
+    S->Chunks[S->NumChunks++] = (struct CursorChunk *)Malloc(sizeof(struct CursorChunk));
+}
+
+CursorSpace CreateCursorSpace(void)
+{
+    CursorSpace S;
+    S = (CursorSpace)Malloc(sizeof(struct CursorSpaceRecord));
+    S->MaxChunks = 4;
+    S->NumChunks = 0;
+    S->Chunks = (struct CursorChunk **)Malloc(sizeof(struct CursorChunk *) * S->MaxChunks);
+    AddChunk(S);
+    CursorNext(0, S) = 0;
+    S->Top = 1;
+    return S;
+}
+
+void DisposeCursorSpace(CursorSpace S)
+{
+    unsigned int i;
+    if (S != NULL)
+    {
+        for (i = 0; i < S->NumChunks; i++)
+            Free(S->Chunks[i]);
+        Free(S->Chunks);
+        Free(S);
+    }
+}
+
+// free list first, then untouched nodes above Top
+Position CursorAlloc(CursorSpace S)
+{
+    Position P;
+    P = CursorNext(0, S);
+    if (P != 0)
+    {
+        CursorNext(0, S) = CursorNext(P, S);
+        return P;
+    }
+    if (S->Top == 0)
+        runtime_error("Out of space!!!");
+    if ((S->Top >> CursorChunkShift) == S->NumChunks)
+        AddChunk(S);
+    return S->Top++;
+}
+
+void CursorFree(Position P, CursorSpace S)
+{
+    CursorNext(P, S) = CursorNext(0, S);
+    CursorNext(0, S) = P;
+}
+
+// N nodes linked in a chain ending in 0
+Position CursorAllocRange(unsigned int N, CursorSpace S)
+{
+    Position First = 0, Last = 0, P;
+
+    for (; N > 0; N--)
+    {
+        P = CursorAlloc(S);
+        if (First == 0)
+            First = P;
+        else
+            CursorNext(Last, S) = P;
+        Last = P;
+    }
+    if (Last != 0)
+        CursorNext(Last, S) = 0;
+    return First;
+}
+
+// gives back a whole chain First..Last in O(1)
+void CursorFreeRange(Position First, Position Last, CursorSpace S)
+{
+    if (First == 0)
+        return;
+    CursorNext(Last, S) = CursorNext(0, S);
+    CursorNext(0, S) = First;
+}
+
+// N nodes with consecutive indices taken above Top, linked in index order
+static Position CursorAllocContiguous(unsigned int N, CursorSpace S)
+{
+    Position First, P;
+
+    if (N == 0)
+        return 0;
+    if (S->Top == 0 || N - 1 > ~S->Top)
+        runtime_error("Out of space!!!");
+    First = S->Top;
+    while (((First + N - 1) >> CursorChunkShift) >= S->NumChunks)
+        AddChunk(S);
+    for (P = First; P != First + N - 1; P++)
+        CursorNext(P, S) = P + 1;
+    CursorNext(P, S) = 0;
+    S->Top = P + 1;
+    return First;
+}
+
+static void DeleteNode(Position P, CursorSpace S)
+{
+    CursorFree(P, S);
+}
+
+static Position NewNode(ElementType X, Position PNext, CursorSpace S)
+{
+    Position P = CursorAlloc(S);
+    CursorElement(P, S) = X;
+    CursorNext(P, S) = PNext;
+    return P;
+}
+
+List Init(CursorSpace S)
+{
+    return NewNode(0, 0, S);
+}
+
+List MakeEmpty(List L, CursorSpace S)
+{
+    Position First, Last;
+    First = CursorNext(L, S);
+    if (First != 0)
+    {
+        for (Last = First; CursorNext(Last, S) != 0; Last = CursorNext(Last, S))
+            ;
+        CursorFreeRange(First, Last, S);
+        CursorNext(L, S) = 0;
+    }
+    return L;
+}
+
+int IsEmpty(List L, CursorSpace S)
+{
+    return CursorNext(L, S) == 0;
+}
+
+int IsLast(Position P, List L, CursorSpace S)
+{
+    (void)L;
+    return CursorNext(P, S) == 0;
+}
+
+// over a run of physically consecutive nodes both arrays are read
+// sequentially, CursorScanBlock nodes at a time without branches
+Position Find(ElementType X, List L, CursorSpace S)
+{
+    Position P;
+    struct CursorChunk *C;
+    unsigned int i, k, Steps;
+    int Hit, Seq;
+
+    P = CursorNext(L, S);
+    while (P != 0)
+    {
+        C = S->Chunks[P >> CursorChunkShift];
+        i = P & (CursorChunkSize - 1);
+        while (i + CursorScanBlock <= CursorChunkSize)
+        {
+            Hit = 0;
+            Seq = 1;
+            for (k = 0; k < CursorScanBlock; k++)
+            {
+                Hit |= C->Element[i + k] == X;
+                Seq &= C->Next[i + k] == P + k + 1;
+            }
+            if (Hit || !Seq)
+                break;
+            i += CursorScanBlock;
+            P += CursorScanBlock;
+        }
+        for (Steps = 0; P != 0 && Steps < CursorScanBlock; Steps++)
+        {
+            if (CursorElement(P, S) == X)
+                return P;
+            P = CursorNext(P, S);
+        }
+    }
+    return 0;
+}
+
+void Delete(ElementType X, List L, CursorSpace S)
+{
+    Position P, TmpCell;
+    P = FindPrevious(X, L, S);
+    if (!IsLast(P, L, S))
+    {
+        TmpCell = CursorNext(P, S);
+        CursorNext(P, S) = CursorNext(TmpCell, S);
+        DeleteNode(TmpCell, S);
+    }
+}
+
+Position FindPrevious(ElementType X, const List L, CursorSpace S)
+{
+    Position P;
+    P = L;
+    while (CursorNext(P, S) != 0 && CursorElement(CursorNext(P, S), S) != X)
+        P = CursorNext(P, S);
+    return P;
+}
+
+void Insert(ElementType X, List L, Position P, CursorSpace S)
+{
+    Position TmpCell;
+    (void)L;
+    TmpCell = NewNode(X, CursorNext(P, S), S);
+    CursorNext(P, S) = TmpCell;
+}
+
+void DeleteList(List L, CursorSpace S)
+{
+    MakeEmpty(L, S);
+    DeleteNode(L, S);
+}
+
+// copies the list into a fresh run of consecutive nodes so Find can scan it block-wise
+void Compact(List L, CursorSpace S)
+{
+    Position P, Last = 0, Q, First;
+    unsigned int N = 0;
+
+    for (P = CursorNext(L, S); P != 0; P = CursorNext(P, S))
+        N++;
+    if (N == 0)
+        return;
+    First = CursorAllocContiguous(N, S);
+    for (P = CursorNext(L, S), Q = First; P != 0; P = CursorNext(P, S), Q++)
+    {
+        CursorElement(Q, S) = CursorElement(P, S);
+        Last = P;
+    }
+    CursorFreeRange(CursorNext(L, S), Last, S);
+    CursorNext(L, S) = First;
+}
+
+Position Header(const List L)
+{
+    return L;
+}
+
+Position First(const List L, CursorSpace S)
+{
+    return CursorNext(L, S);
+}
+
+Position Advance(const Position P, CursorSpace S)
+{
+    return CursorNext(P, S);
+}
+
+ElementType Retrieve(const Position P, CursorSpace S)
+{
+    return CursorElement(P, S);
+}
+
+#endif
+
+#ifdef _Stack_h
+
+static PtrToNode NewNode(ElementType X, PtrToNode PNext)
+{
+    PtrToNode P = (PtrToNode)Malloc(sizeof(struct Node));
+    P->Element = X;
+    P->Next = PNext;
+    return P;
+}
+
+static void DeleteNode(PtrToNode P)
+{
+    Free(P);
+}
+
+int IsEmpty(Stack S)
+{
+    return S->Next == NULL;
+}
+
+Stack CreateStack(void)
+{
+    Stack S;
+    S = NewNode(0, NULL);
+    MakeEmpty(S);
+    return S;
+}
+
+void DisposeStack(Stack S)
+{
+    MakeEmpty(S);
+    DeleteNode(S);
+}
+
+void MakeEmpty(Stack S)
+{
+    if (S == NULL)
+        runtime_error("Must use CreateStack first");
+    else
+        while (!IsEmpty(S))
+            Pop(S);
+}
+
+void Push(ElementType X, Stack S)
+{
+    PtrToNode TmpCell;
+    TmpCell = NewNode(X, S->Next);
+    S->Next = TmpCell;
+    return;
+}
+
+ElementType Top(Stack S)
+{
+    if (!IsEmpty(S))
+        return S->Next->Element;
+    runtime_error("Empty Stack");
+    return 0;
+}
+
+void Pop(Stack S)
+{
+    PtrToNode TmpCell = S->Next;
+    if (TmpCell == NULL)
+        runtime_error("Empty Stack");
+    S->Next = TmpCell->Next;
+    DeleteNode(TmpCell);
+}
+
+#endif
+
+#ifdef _Stack_H
+
+static void Reserve(int Needed, Stack S)
+{
+    int NewCapacity = S->Capacity;
+
+    if (Needed <= S->Capacity)
+        return;
+    while (NewCapacity < Needed)
+        NewCapacity *= 2;
+    if (S->Array == S->Inline)
+    {
+        S->Array = (ElementType *)Malloc(sizeof(ElementType) * NewCapacity);
+        memcpy(S->Array, S->Inline, sizeof(ElementType) * (S->TopOfStack + 1));
+    }
+    else
+        S->Array = (ElementType *)Realloc(S->Array, sizeof(ElementType) * NewCapacity);
+    S->Capacity = NewCapacity;
+}
+
+int IsEmpty(Stack S)
+{
+    return S->TopOfStack == EmptyTOS;
+}
+
+// kept for the old fixed-size API; Push and PushN grow the array on demand
+int IsFull(Stack S)
+{
+    (void)S;
+    return 0;
+}
+
+Stack CreateStack(int MaxElements)
+{
+    Stack S;
+    S = InitStack((Stack)Malloc(sizeof(struct StackRecord)));
+    Reserve(MaxElements, S);
+    return S;
+}
+
+// for a record that lives on the caller's stack; pair with FreeStack
+Stack InitStack(struct StackRecord *S)
+{
+    S->Array = S->Inline;
+    S->Capacity = StackInlineSize;
+    MakeEmpty(S);
+    return S;
+}
+
+void FreeStack(Stack S)
+{
+    if (S->Array != S->Inline)
+        Free(S->Array);
+    InitStack(S);
+}
+
+void DisposeStack(Stack S)
+{
+    if (S != NULL)
+    {
+        FreeStack(S);
+        Free(S);
+    }
+}
+
+void MakeEmpty(Stack S)
+{
+    S->TopOfStack = EmptyTOS;
+}
+
+void Push(ElementType X, Stack S)
+{
+    if (S->TopOfStack == S->Capacity - 1)
+        Reserve(S->Capacity + 1, S);
+    S->Array[++S->TopOfStack] = X;
+}
+
+// X[N - 1] ends up on top
+void PushN(const ElementType *X, int N, Stack S)
+{
+    if (N < 0)
+        runtime_error("Negative element count");
+    Reserve(S->TopOfStack + 1 + N, S);
+    memcpy(S->Array + S->TopOfStack + 1, X, sizeof(ElementType) * N);
+    S->TopOfStack += N;
+}
+
+ElementType Top(Stack S)
+{
+    if (!IsEmpty(S))
+        return S->Array[S->TopOfStack];
+    runtime_error("Empty Stack");
+    return 0;
+}
+
+void Pop(Stack S)
+{
+    if (IsEmpty(S))
+        runtime_error("Empty Stack");
+    else
+        S->TopOfStack--;
+}
+
+// the N topmost elements are copied to X in the order PushN took them; X may be NULL
+void PopN(ElementType *X, int N, Stack S)
+{
+    if (N < 0)
+        runtime_error("Negative element count");
+    if (N > S->TopOfStack + 1)
+        runtime_error("Empty Stack");
+    S->TopOfStack -= N;
+    if (X != NULL)
+        memcpy(X, S->Array + S->TopOfStack + 1, sizeof(ElementType) * N);
+}
+
+ElementType TopAndPop(Stack S)
+{
+    if (!IsEmpty(S))
+        return S->Array[S->TopOfStack--];
+    runtime_error("Empty Stack");
+    return 0;
+}
+
+#endif
+
+#ifdef _Queue_h
+
+int IsEmpty(Queue Q)
+{
+    return Q->Size == 0;
+}
+
+int IsFull(Queue Q)
+{
+    return Q->Capacity == Q->Size;
+}
+
+Queue CreateQueue(int MaxElements)
+{
+    Queue Q;
+    if (MaxElements < MinQueueSize)
+        runtime_error("Queue size if too small");
+    Q = (Queue)Malloc(sizeof(struct QueueRecord));
+    Q->Array = (ElementType *)Malloc(sizeof(ElementType) * MaxElements);
+    Q->Capacity = MaxElements;
+    MakeEmpty(Q);
+    return Q;
+}
+
+void DisposeQueue(Queue Q)
+{
+    if (Q != NULL)
+    {
+        Free(Q->Array);
+        Free(Q);
+    }
+}
+
+void MakeEmpty(Queue Q)
+{
+    Q->Front = 0;
+    Q->Rear = -1;
+    Q->Size = 0;
+    return;
+}
+
+static int Succ(int Value, Queue Q)
+{
+    if (++Value == Q->Capacity)
+        Value = 0;
+    return Value;
+}
+
+void Enqueue(ElementType X, Queue Q)
+{
+    if (IsFull(Q))
+        runtime_error("Full queue");
+    else
+    {
+        Q->Size++;
+        Q->Rear = Succ(Q->Rear, Q);
+        Q->Array[Q->Rear] = X;
+    }
+}
+
+ElementType Front(Queue Q)
+{
+    if (IsEmpty(Q))
+        runtime_error("Empty queue");
+    return Q->Array[Q->Front];
+}
+
+void Dequeue(Queue Q)
+{
+    if (IsEmpty(Q))
+        runtime_error("Empty queue");
+    else
+    {
+        Q->Size--;
+        Q->Front = Succ(Q->Front, Q);
+    }
+}
+
+ElementType FrontAndDequeue(Queue Q)
+{
+    ElementType X = Front(Q);
+    Dequeue(Q);
+    return X;
+}
+
+#endif
+
+#ifdef _SpscQueue_h
+
+static unsigned long RoundUpPowerOfTwo(unsigned long Value)
+{
+    unsigned long Power = 1;
+    while (Power < Value)
+        Power <<= 1;
+    return Power;
+}
+
+Queue CreateQueue(int MaxElements)
+{
+    Queue Q;
+    if (MaxElements < MinQueueSize)
+        runtime_error("Queue size if too small");
+    Q = (Queue)Malloc(sizeof(struct QueueRecord));
+    Q->Mask = RoundUpPowerOfTwo(MaxElements) - 1;
+    Q->Array = (ElementType *)Malloc(sizeof(ElementType) * (Q->Mask + 1));
+    atomic_init(&Q->Front, 0);
+    atomic_init(&Q->Rear, 0);
+    Q->RearCache = 0;
+    Q->FrontCache = 0;
+    return Q;
+}
+
+void DisposeQueue(Queue Q)
+{
+    if (Q != NULL)
+    {
+        Free(Q->Array);
+        Free(Q);
+    }
+}
+
+int IsEmpty(Queue Q)
+{
+    return atomic_load_explicit(&Q->Rear, memory_order_acquire) ==
+           atomic_load_explicit(&Q->Front, memory_order_acquire);
+}
+
+int IsFull(Queue Q)
+{
+    return atomic_load_explicit(&Q->Rear, memory_order_acquire) -
+               atomic_load_explicit(&Q->Front, memory_order_acquire) >
+           Q->Mask;
+}
+
+// producer side: only touches Front when the cached copy says the ring is full
+int TryEnqueue(ElementType X, Queue Q)
+{
+    unsigned long Rear = atomic_load_explicit(&Q->Rear, memory_order_relaxed);
+
+    if (Rear - Q->FrontCache > Q->Mask)
+    {
+        Q->FrontCache = atomic_load_explicit(&Q->Front, memory_order_acquire);
+        if (Rear - Q->FrontCache > Q->Mask)
+            return 0;
+    }
+    Q->Array[Rear & Q->Mask] = X;
+    atomic_store_explicit(&Q->Rear, Rear + 1, memory_order_release);
+    return 1;
+}
+
+// consumer side: only touches Rear when the cached copy says the ring is empty
+int TryDequeue(ElementType *X, Queue Q)
+{
+    unsigned long Front = atomic_load_explicit(&Q->Front, memory_order_relaxed);
+
+    if (Front == Q->RearCache)
+    {
+        Q->RearCache = atomic_load_explicit(&Q->Rear, memory_order_acquire);
+        if (Front == Q->RearCache)
+            return 0;
+    }
+    *X = Q->Array[Front & Q->Mask];
+    atomic_store_explicit(&Q->Front, Front + 1, memory_order_release);
+    return 1;
+}
+
+void Enqueue(ElementType X, Queue Q)
+{
+    while (!TryEnqueue(X, Q))
+        ;
+}
+
+ElementType FrontAndDequeue(Queue Q)
+{
+    ElementType X;
+    while (!TryDequeue(&X, Q))
+        ;
+    return X;
+}
+
+int EnqueueN(const ElementType *X, int N, Queue Q)
+{
+    unsigned long Rear, Free, Start, First;
+
+    if (N <= 0)
+        return 0;
+    Rear = atomic_load_explicit(&Q->Rear, memory_order_relaxed);
+    Free = Q->Mask + 1 - (Rear - Q->FrontCache);
+    if (Free < (unsigned long)N)
+    {
+        Q->FrontCache = atomic_load_explicit(&Q->Front, memory_order_acquire);
+        Free = Q->Mask + 1 - (Rear - Q->FrontCache);
+    }
+    if (Free > (unsigned long)N)
+        Free = N;
+    if (Free == 0)
+        return 0;
+
+    Start = Rear & Q->Mask;
+    First = Q->Mask + 1 - Start;
+    if (First > Free)
+        First = Free;
+    memcpy(Q->Array + Start, X, sizeof(ElementType) * First);
+    memcpy(Q->Array, X + First, sizeof(ElementType) * (Free - First));
+    atomic_store_explicit(&Q->Rear, Rear + Free, memory_order_release);
+    return Free;
+}
+
+int DequeueN(ElementType *X, int N, Queue Q)
+{
+    unsigned long Front, Used, Start, First;
+
+    if (N <= 0)
+        return 0;
+    Front = atomic_load_explicit(&Q->Front, memory_order_relaxed);
+    Used = Q->RearCache - Front;
+    if (Used < (unsigned long)N)
+    {
+        Q->RearCache = atomic_load_explicit(&Q->Rear, memory_order_acquire);
+        Used = Q->RearCache - Front;
+    }
+    if (Used > (unsigned long)N)
+        Used = N;
+    if (Used == 0)
+        return 0;
+
+    Start = Front & Q->Mask;
+    First = Q->Mask + 1 - Start;
+    if (First > Used)
+        First = Used;
+    memcpy(X, Q->Array + Start, sizeof(ElementType) * First);
+    memcpy(X + First, Q->Array, sizeof(ElementType) * (Used - First));
+    atomic_store_explicit(&Q->Front, Front + Used, memory_order_release);
+    return Used;
+}
+
+#endif
+
+#ifdef _MpmcQueue_h
+
+static unsigned long RoundUpPowerOfTwo(unsigned long Value)
+{
+    unsigned long Power = 1;
+    while (Power < Value)
+        Power <<= 1;
+    return Power;
+}
+
+Queue CreateQueue(int MaxElements)
+{
+    Queue Q;
+    unsigned long i;
+
+    if (MaxElements < MinQueueSize)
+        runtime_error("Queue size if too small");
+    Q = (Queue)Malloc(sizeof(struct QueueRecord));
+    Q->Mask = RoundUpPowerOfTwo(MaxElements) - 1;
+    Q->Cells = (struct QueueCell *)Malloc(sizeof(struct QueueCell) * (Q->Mask + 1));
+    for (i = 0; i <= Q->Mask; i++)
+        atomic_init(&Q->Cells[i].Sequence, i);
+    atomic_init(&Q->Front, 0);
+    atomic_init(&Q->Rear, 0);
+    return Q;
+}
+
+void DisposeQueue(Queue Q)
+{
+    if (Q != NULL)
+    {
+        Free(Q->Cells);
+        Free(Q);
+    }
+}
+
+int IsEmpty(Queue Q)
+{
+    return atomic_load_explicit(&Q->Rear, memory_order_acquire) ==
+           atomic_load_explicit(&Q->Front, memory_order_acquire);
+}
+
+int IsFull(Queue Q)
+{
+    return atomic_load_explicit(&Q->Rear, memory_order_acquire) -
+               atomic_load_explicit(&Q->Front, memory_order_acquire) >
+           Q->Mask;
+}
+
+// a cell is free for position Pos when its sequence equals Pos,
+// and holds the element of position Pos when its sequence equals Pos + 1
+int TryEnqueue(ElementType X, Queue Q)
+{
+    struct QueueCell *Cell;
+    unsigned long Pos, Seq;
+    long Dif;
+
+    Pos = atomic_load_explicit(&Q->Rear, memory_order_relaxed);
+    for (;;)
+    {
+        Cell = &Q->Cells[Pos & Q->Mask];
+        Seq = atomic_load_explicit(&Cell->Sequence, memory_order_acquire);
+        Dif = (long)Seq - (long)Pos;
+        if (Dif == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&Q->Rear, &Pos, Pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (Dif < 0)
+            return 0;
+        else
+            Pos = atomic_load_explicit(&Q->Rear, memory_order_relaxed);
+    }
+    Cell->Element = X;
+    atomic_store_explicit(&Cell->Sequence, Pos + 1, memory_order_release);
+    return 1;
+}
+
+int TryDequeue(ElementType *X, Queue Q)
+{
+    struct QueueCell *Cell;
+    unsigned long Pos, Seq;
+    long Dif;
+
+    Pos = atomic_load_explicit(&Q->Front, memory_order_relaxed);
+    for (;;)
+    {
+        Cell = &Q->Cells[Pos & Q->Mask];
+        Seq = atomic_load_explicit(&Cell->Sequence, memory_order_acquire);
+        Dif = (long)Seq - (long)(Pos + 1);
+        if (Dif == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&Q->Front, &Pos, Pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (Dif < 0)
+            return 0;
+        else
+            Pos = atomic_load_explicit(&Q->Front, memory_order_relaxed);
+    }
+    *X = Cell->Element;
+    atomic_store_explicit(&Cell->Sequence, Pos + Q->Mask + 1, memory_order_release);
+    return 1;
+}
+
+void Enqueue(ElementType X, Queue Q)
+{
+    while (!TryEnqueue(X, Q))
+        ;
+}
+
+ElementType FrontAndDequeue(Queue Q)
+{
+    ElementType X;
+    while (!TryDequeue(&X, Q))
+        ;
+    return X;
+}
+
+// claims a run of free cells with a single CAS on Rear; a free cell can
+// only change state after its position is claimed, so the run stays valid
+int EnqueueN(const ElementType *X, int N, Queue Q)
+{
+    unsigned long Pos;
+    int i, Run;
+
+    Pos = atomic_load_explicit(&Q->Rear, memory_order_relaxed);
+    do
+    {
+        for (Run = 0; Run < N && Run <= (int)Q->Mask; Run++)
+            if (atomic_load_explicit(&Q->Cells[(Pos + Run) & Q->Mask].Sequence,
+                                     memory_order_acquire) != Pos + Run)
+                break;
+        if (Run == 0)
+        {
+            unsigned long Now = atomic_load_explicit(&Q->Rear, memory_order_relaxed);
+            if (Now == Pos)
+                return 0;
+            Pos = Now;
+            continue;
+        }
+    } while (Run == 0 || !atomic_compare_exchange_weak_explicit(&Q->Rear, &Pos, Pos + Run,
+                                                                memory_order_relaxed, memory_order_relaxed));
+
+    for (i = 0; i < Run; i++)
+    {
+        struct QueueCell *Cell = &Q->Cells[(Pos + i) & Q->Mask];
+        Cell->Element = X[i];
+        atomic_store_explicit(&Cell->Sequence, Pos + i + 1, memory_order_release);
+    }
+    return Run;
+}
+
+int DequeueN(ElementType *X, int N, Queue Q)
+{
+    unsigned long Pos;
+    int i, Run;
+
+    Pos = atomic_load_explicit(&Q->Front, memory_order_relaxed);
+    do
+    {
+        for (Run = 0; Run < N && Run <= (int)Q->Mask; Run++)
+            if (atomic_load_explicit(&Q->Cells[(Pos + Run) & Q->Mask].Sequence,
+                                     memory_order_acquire) != Pos + Run + 1)
+                break;
+        if (Run == 0)
+        {
+            unsigned long Now = atomic_load_explicit(&Q->Front, memory_order_relaxed);
+            if (Now == Pos)
+                return 0;
+            Pos = Now;
+            continue;
+        }
+    } while (Run == 0 || !atomic_compare_exchange_weak_explicit(&Q->Front, &Pos, Pos + Run,
+                                                                memory_order_relaxed, memory_order_relaxed));
+
+    for (i = 0; i < Run; i++)
+    {
+        struct QueueCell *Cell = &Q->Cells[(Pos + i) & Q->Mask];
+        X[i] = Cell->Element;
+        atomic_store_explicit(&Cell->Sequence, Pos + i + Q->Mask + 1, memory_order_release);
+    }
+    return Run;
+}
+
+#endif
+
+#ifdef _Queue_H
+
+PtrToNode NewNode(ElementType X, PtrToNode PNext)
+{
+    PtrToNode P;
+    P = (PtrToNode)Malloc(sizeof(struct Node));
+    P->Element = X;
+    P->Next = PNext;
+    return P;
+}
+
+void DeleteNode(PtrToNode P)
+{
+    Free(P);
+}
+
+int IsEmpty(Queue Q)
+{
+    return Q->Size == 0; // or Q->Front==NULL && Q->Rear==NULL;
+}
+
+Queue CreateQueue()
+{
+    Queue Q;
+    Q = (Queue)Malloc(sizeof(struct QueueRecord));
+    Q->Front = NULL;
+    Q->Rear = NULL;
+    Q->Size = 0;
+    return Q;
+}
+
+void DisposeQueue(Queue Q)
+{
+    PtrToNode P;
+    P = Q->Front;
+    while (P != NULL)
+    {
+        PtrToNode PN = P->Next;
+        DeleteNode(P);
+        P = PN;
+    }
+    Free(Q);
+}
+
+void MakeEmpty(Queue Q)
+{
+    PtrToNode P;
+    P = Q->Front;
+    while (P != NULL)
+    {
+        PtrToNode PN = P->Next;
+        DeleteNode(P);
+        P = PN;
+    }
+    Q->Front = NULL;
+    Q->Rear = NULL;
+    Q->Size = 0;
+}
+
+void Enqueue(ElementType X, Queue Q)
+{
+    PtrToNode P = NewNode(X, NULL);
+    if (IsEmpty(Q))
+        Q->Front = Q->Rear = P;
+    else
+    {
+        Q->Rear->Next = P;
+        Q->Rear = P;
+    }
+    Q->Size++;
+}
+
+ElementType Front(Queue Q)
+{
+    if (IsEmpty(Q))
+        runtime_error("Empty queue");
+    return Q->Front->Element;
+}
+
+void Dequeue(Queue Q)
+{
+    if (IsEmpty(Q))
+        runtime_error("Empty queue");
+    else
+    {
+        PtrToNode P;
+        Q->Size--;
+        P = Q->Front;
+        Q->Front = Q->Front->Next;
+        DeleteNode(P);
+    }
+    if (IsEmpty(Q))
+        Q->Front = Q->Rear = NULL;
+}
+
+ElementType FrontAndDequeue(Queue Q)
+{
+    ElementType X = Front(Q);
+    Dequeue(Q);
+    return X;
+}
+
+#endif
+
+#ifdef _IntrusiveQueue_H
+
+// the record may live anywhere, typically inside the owner's struct
+Queue InitQueue(struct QueueRecord *Q)
+{
+    MakeEmpty(Q);
+    return Q;
+}
+
+int IsEmpty(Queue Q)
+{
+    return Q->Size == 0;
+}
+
+// forgets the queued links, their storage belongs to the caller
+void MakeEmpty(Queue Q)
+{
+    Q->Front = NULL;
+    Q->Rear = NULL;
+    Q->Size = 0;
+}
+
+void Enqueue(PtrToNode X, Queue Q)
+{
+    X->Next = NULL;
+    if (IsEmpty(Q))
+        Q->Front = Q->Rear = X;
+    else
+    {
+        Q->Rear->Next = X;
+        Q->Rear = X;
+    }
+    Q->Size++;
+}
+
+PtrToNode Front(Queue Q)
+{
+    if (IsEmpty(Q))
+        runtime_error("Empty queue");
+    return Q->Front;
+}
+
+void Dequeue(Queue Q)
+{
+    if (IsEmpty(Q))
+        runtime_error("Empty queue");
+    Q->Front = Q->Front->Next;
+    if (--Q->Size == 0)
+        Q->Rear = NULL;
+}
+
+PtrToNode FrontAndDequeue(Queue Q)
+{
+    PtrToNode X = Front(Q);
+    Dequeue(Q);
+    return X;
+}
+
+#endif
+
+#ifdef _LockFreeQueue_H
+
+// take from the thread's own free list, then grab the whole shared pool
+static PtrToNode NewNode(ElementType X, Queue Q, ThreadHandle R)
+{
+    PtrToNode P;
+
+    if (R->FreeNodes == NULL)
+    {
+        R->FreeNodes = atomic_exchange_explicit(&Q->FreePool, NULL, memory_order_acquire);
+        R->NumFree = 0;
+        for (P = R->FreeNodes; P != NULL; P = P->FreeNext)
+            R->NumFree++;
+    }
+    if (R->FreeNodes != NULL)
+    {
+        P = R->FreeNodes;
+        R->FreeNodes = P->FreeNext;
+        R->NumFree--;
+    }
+    else
+        P = (PtrToNode)Malloc(sizeof(struct Node));
+    P->Element = X;
+    atomic_store_explicit(&P->Next, NULL, memory_order_relaxed);
+    P->FreeNext = NULL;
+    return P;
+}
+
+static void Retire(PtrToNode P, Queue Q, ThreadHandle R)
+{
+    int Threshold;
+
+    P->FreeNext = R->Retired;
+    R->Retired = P;
+    R->NumRetired++;
+
+    Threshold = 2 * HazardsPerThread * atomic_load_explicit(&Q->NumRecords, memory_order_relaxed);
+    if (Threshold < RetireThreshold)
+        Threshold = RetireThreshold;
+    if (R->NumRetired >= Threshold)
+        Scan(Q, R);
+}
+
+// move every retired node that no thread has published as a hazard to the
+// free list, and hand surplus free nodes to the shared pool in one CAS
+static void Scan(Queue Q, ThreadHandle R)
+{
+    PtrToNode *Hazards, P, PN, Keep, Tail, Top;
+    ThreadHandle T;
+    int i, NumHazards, Capacity;
+
+    Capacity = HazardsPerThread * atomic_load_explicit(&Q->NumRecords, memory_order_acquire);
+    if (R->SnapshotSize < Capacity)
+    {
+        R->SnapshotSize = 2 * Capacity;
+        R->Snapshot = (PtrToNode *)Realloc(R->Snapshot, sizeof(PtrToNode) * R->SnapshotSize);
+    }
+    Hazards = R->Snapshot;
+    NumHazards = 0;
+    for (T = atomic_load_explicit(&Q->Records, memory_order_acquire); T != NULL; T = T->Next)
+        for (i = 0; i < HazardsPerThread; i++)
+        {
+            P = atomic_load_explicit(&T->Hazard[i], memory_order_seq_cst);
+            if (P != NULL && NumHazards < Capacity)
+                Hazards[NumHazards++] = P;
+        }
+
+    Keep = NULL;
+    R->NumRetired = 0;
+    for (P = R->Retired; P != NULL; P = PN)
+    {
+        PN = P->FreeNext;
+        for (i = 0; i < NumHazards && Hazards[i] != P; i++)
+            ;
+        if (i < NumHazards)
+        {
+            P->FreeNext = Keep;
+            Keep = P;
+            R->NumRetired++;
+        }
+        else
+        {
+            P->FreeNext = R->FreeNodes;
+            R->FreeNodes = P;
+            R->NumFree++;
+        }
+    }
+    R->Retired = Keep;
+
+    if (R->NumFree > MaxFreeNodes)
+    {
+        for (Tail = R->FreeNodes; Tail->FreeNext != NULL; Tail = Tail->FreeNext)
+            ;
+        Top = atomic_load_explicit(&Q->FreePool, memory_order_relaxed);
+        do
+            Tail->FreeNext = Top;
+        while (!atomic_compare_exchange_weak_explicit(&Q->FreePool, &Top, R->FreeNodes,
+                                                      memory_order_release, memory_order_relaxed));
+        R->FreeNodes = NULL;
+        R->NumFree = 0;
+    }
+}
+
+static void DeleteChain(PtrToNode P)
+{
+    PtrToNode PN;
+    while (P != NULL)
+    {
+        PN = P->FreeNext;
+        Free(P);
+        P = PN;
+    }
+}
+
+Queue CreateQueue(void)
+{
+    Queue Q;
+    PtrToNode Dummy;
+
+    Q = (Queue)Malloc(sizeof(struct QueueRecord));
+    Dummy = (PtrToNode)Malloc(sizeof(struct Node));
+    atomic_init(&Dummy->Next, NULL);
+    Dummy->FreeNext = NULL;
+    atomic_init(&Q->Front, Dummy);
+    atomic_init(&Q->Rear, Dummy);
+    atomic_init(&Q->FreePool, NULL);
+    atomic_init(&Q->Records, NULL);
+    atomic_init(&Q->NumRecords, 0);
+    return Q;
+}
+
+// must only be called once every thread has detached
+void DisposeQueue(Queue Q)
+{
+    PtrToNode P, PN;
+    ThreadHandle R, RN;
+
+    for (P = atomic_load(&Q->Front); P != NULL; P = PN)
+    {
+        PN = atomic_load_explicit(&P->Next, memory_order_relaxed);
+        Free(P);
+    }
+    for (R = atomic_load(&Q->Records); R != NULL; R = RN)
+    {
+        RN = R->Next;
+        DeleteChain(R->Retired);
+        DeleteChain(R->FreeNodes);
+        Free(R->Snapshot);
+        Free(R);
+    }
+    DeleteChain(atomic_load(&Q->FreePool));
+    Free(Q);
+}
+
+ThreadHandle AttachThread(Queue Q)
+{
+    ThreadHandle R, Head;
+    int i, Expected;
+
+    for (R = atomic_load_explicit(&Q->Records, memory_order_acquire); R != NULL; R = R->Next)
+    {
+        Expected = 0;
+        if (atomic_compare_exchange_strong(&R->Active, &Expected, 1))
+            return R;
+    }
+
+    R = (ThreadHandle)Malloc(sizeof(struct ThreadRecord));
+    for (i = 0; i < HazardsPerThread; i++)
+        atomic_init(&R->Hazard[i], NULL);
+    atomic_init(&R->Active, 1);
+    R->Retired = NULL;
+    R->NumRetired = 0;
+    R->FreeNodes = NULL;
+    R->NumFree = 0;
+    R->Snapshot = NULL;
+    R->SnapshotSize = 0;
+
+    atomic_fetch_add(&Q->NumRecords, 1);
+    Head = atomic_load_explicit(&Q->Records, memory_order_relaxed);
+    do
+        R->Next = Head;
+    while (!atomic_compare_exchange_weak_explicit(&Q->Records, &Head, R,
+                                                  memory_order_release, memory_order_relaxed));
+    return R;
+}
+
+// the record keeps its retired and free nodes for the next thread to attach
+void DetachThread(ThreadHandle R)
+{
+    int i;
+    for (i = 0; i < HazardsPerThread; i++)
+        atomic_store(&R->Hazard[i], NULL);
+    atomic_store(&R->Active, 0);
+}
+
+int IsEmpty(Queue Q)
+{
+    PtrToNode Front = atomic_load(&Q->Front);
+    return atomic_load(&Front->Next) == NULL;
+}
+
+void Enqueue(ElementType X, Queue Q, ThreadHandle R)
+{
+    PtrToNode P, Rear, Next;
+
+    P = NewNode(X, Q, R);
+    for (;;)
+    {
+        Rear = atomic_load(&Q->Rear);
+        atomic_store(&R->Hazard[0], Rear);
+        if (Rear != atomic_load(&Q->Rear))
+            continue;
+        Next = atomic_load(&Rear->Next);
+        if (Rear != atomic_load(&Q->Rear))
+            continue;
+        if (Next != NULL)
+        {
+            atomic_compare_exchange_strong(&Q->Rear, &Rear, Next);
+            continue;
+        }
+        if (atomic_compare_exchange_strong(&Rear->Next, &Next, P))
+        {
+            atomic_compare_exchange_strong(&Q->Rear, &Rear, P);
+            break;
+        }
+    }
+    atomic_store_explicit(&R->Hazard[0], NULL, memory_order_release);
+}
+
+int TryDequeue(ElementType *X, Queue Q, ThreadHandle R)
+{
+    PtrToNode Front, Rear, Next;
+
+    for (;;)
+    {
+        Front = atomic_load(&Q->Front);
+        atomic_store(&R->Hazard[0], Front);
+        if (Front != atomic_load(&Q->Front))
+            continue;
+        Rear = atomic_load(&Q->Rear);
+        Next = atomic_load(&Front->Next);
+        atomic_store(&R->Hazard[1], Next);
+        if (Front != atomic_load(&Q->Front))
+            continue;
+        if (Next == NULL)
+        {
+            atomic_store_explicit(&R->Hazard[0], NULL, memory_order_release);
+            atomic_store_explicit(&R->Hazard[1], NULL, memory_order_release);
+            return 0;
+        }
+        if (Front == Rear)
+        {
+            atomic_compare_exchange_strong(&Q->Rear, &Rear, Next);
+            continue;
+        }
+        *X = Next->Element;
+        if (atomic_compare_exchange_strong(&Q->Front, &Front, Next))
+            break;
+    }
+    atomic_store_explicit(&R->Hazard[0], NULL, memory_order_release);
+    atomic_store_explicit(&R->Hazard[1], NULL, memory_order_release);
+    Retire(Front, Q, R);
+    return 1;
+}
+
+#endif
+
+#ifdef _TimingWheel_H
+
+static Timer NewTimer(ElementType X, unsigned long Expires, TimingWheel W)
+{
+    Timer T;
+    if (W->FreeTimers != NULL)
+    {
+        T = W->FreeTimers;
+        W->FreeTimers = T->Next;
+    }
+    else
+        T = (Timer)Malloc(sizeof(struct TimerNode));
+    T->Element = X;
+    T->Expires = Expires;
+    T->Prev = T->Next = NULL;
+    T->Slot = NULL;
+    return T;
+}
+
+static void DeleteTimer(Timer T, TimingWheel W)
+{
+    T->Slot = NULL;
+    T->Next = W->FreeTimers;
+    W->FreeTimers = T;
+}
+
+static void Append(Timer T, struct TimerList *L)
+{
+    T->Slot = L;
+    T->Next = NULL;
+    T->Prev = L->Rear;
+    if (L->Rear == NULL)
+        L->Front = T;
+    else
+        L->Rear->Next = T;
+    L->Rear = T;
+}
+
+static void Unlink(Timer T)
+{
+    struct TimerList *L = T->Slot;
+    if (T->Prev == NULL)
+        L->Front = T->Next;
+    else
+        T->Prev->Next = T->Next;
+    if (T->Next == NULL)
+        L->Rear = T->Prev;
+    else
+        T->Next->Prev = T->Prev;
+}
+
+static void PlaceTimer(Timer T, TimingWheel W)
+{
+    unsigned long Idx = T->Expires - W->Current;
+    int i, Shift;
+
+    if ((long)Idx < 0)
+    {
+        Append(T, &W->Root[W->Current & (WheelRootSize - 1)]);
+        return;
+    }
+    if (Idx < WheelRootSize)
+    {
+        Append(T, &W->Root[T->Expires & (WheelRootSize - 1)]);
+        return;
+    }
+    for (i = 0; i < WheelLevels; i++)
+    {
+        Shift = WheelRootBits + i * WheelLevelBits;
+        if (Idx >> Shift < WheelLevelSize || i == WheelLevels - 1)
+        {
+            Append(T, &W->Levels[i][(T->Expires >> Shift) & (WheelLevelSize - 1)]);
+            return;
+        }
+    }
+}
+
+static void Cascade(struct TimerList *L, TimingWheel W)
+{
+    Timer T = L->Front, TN;
+
+    L->Front = L->Rear = NULL;
+    while (T != NULL)
+    {
+        TN = T->Next;
+        PlaceTimer(T, W);
+        T = TN;
+    }
+}
+
+static void FreeList(struct TimerList *L)
+{
+    Timer T = L->Front, TN;
+    while (T != NULL)
+    {
+        TN = T->Next;
+        Free(T);
+        T = TN;
+    }
+    L->Front = L->Rear = NULL;
+}
+
+TimingWheel CreateTimingWheel(void)
+{
+    TimingWheel W;
+    int i, j;
+
+    W = (TimingWheel)Malloc(sizeof(struct WheelRecord));
+    W->Current = 0;
+    W->Size = 0;
+    W->FreeTimers = NULL;
+    W->Firing = NULL;
+    for (i = 0; i < WheelRootSize; i++)
+        W->Root[i].Front = W->Root[i].Rear = NULL;
+    for (i = 0; i < WheelLevels; i++)
+        for (j = 0; j < WheelLevelSize; j++)
+            W->Levels[i][j].Front = W->Levels[i][j].Rear = NULL;
+    return W;
+}
+
+void DisposeTimingWheel(TimingWheel W)
+{
+    Timer T, TN;
+    int i, j;
+
+    for (i = 0; i < WheelRootSize; i++)
+        FreeList(&W->Root[i]);
+    for (i = 0; i < WheelLevels; i++)
+        for (j = 0; j < WheelLevelSize; j++)
+            FreeList(&W->Levels[i][j]);
+    for (T = W->FreeTimers; T != NULL; T = TN)
+    {
+        TN = T->Next;
+        Free(T);
+    }
+    Free(W);
+}
+
+int IsEmpty(TimingWheel W)
+{
+    return W->Size == 0;
+}
+
+Timer AddTimer(ElementType X, unsigned long Delay, TimingWheel W)
+{
+    Timer T;
+
+    if (Delay > MaxTimerDelay)
+        runtime_error("Timer delay is out of range");
+    T = NewTimer(X, W->Current + Delay, W);
+    PlaceTimer(T, W);
+    W->Size++;
+    return T;
+}
+
+// also works on the timer whose callback is running, to make it periodic
+void RearmTimer(Timer T, unsigned long Delay, TimingWheel W)
+{
+    if (Delay > MaxTimerDelay)
+        runtime_error("Timer delay is out of range");
+    if (T == W->Firing)
+        W->Firing = NULL;
+    else if (T->Slot == NULL)
+        runtime_error("Timer is not armed");
+    else
+    {
+        Unlink(T);
+        W->Size--;
+    }
+    T->Expires = W->Current + Delay;
+    PlaceTimer(T, W);
+    W->Size++;
+}
+
+void CancelTimer(Timer T, TimingWheel W)
+{
+    if (T == W->Firing)
+    {
+        W->Firing = NULL;
+        DeleteTimer(T, W);
+        return;
+    }
+    if (T->Slot == NULL)
+        runtime_error("Timer is not armed");
+    Unlink(T);
+    DeleteTimer(T, W);
+    W->Size--;
+}
+
+void Tick(TimingWheel W, TimerCallback Expire)
+{
+    struct TimerList Expired;
+    struct TimerList *L;
+    Timer T;
+    int i, Index, Slot;
+
+    Index = W->Current & (WheelRootSize - 1);
+    if (Index == 0)
+        for (i = 0; i < WheelLevels; i++)
+        {
+            Slot = (W->Current >> (WheelRootBits + i * WheelLevelBits)) & (WheelLevelSize - 1);
+            Cascade(&W->Levels[i][Slot], W);
+            if (Slot != 0)
+                break;
+        }
+
+    // detach the whole slot so callbacks may re-arm into it safely
+    L = &W->Root[Index];
+    Expired = *L;
+    L->Front = L->Rear = NULL;
+    for (T = Expired.Front; T != NULL; T = T->Next)
+        T->Slot = &Expired;
+    W->Current++;
+
+    // the callback may cancel or re-arm T, which clears Firing
+    while ((T = Expired.Front) != NULL)
+    {
+        Unlink(T);
+        T->Slot = NULL;
+        W->Size--;
+        W->Firing = T;
+        Expire(T->Element);
+        if (W->Firing == T)
+        {
+            W->Firing = NULL;
+            DeleteTimer(T, W);
+        }
+    }
+}
+
+void Advance(unsigned long Ticks, TimingWheel W, TimerCallback Expire)
+{
+    while (Ticks-- > 0)
+    {
+        if (IsEmpty(W))
+        {
+            W->Current += Ticks + 1;
+            break;
+        }
+        Tick(W, Expire);
+    }
+}
+
+#endif
+
+#ifdef _Deque_h
+
+static ElementType *AllocBlock(Deque D)
+{
+    if (D->NumSpare > 0)
+        return D->Spare[--D->NumSpare];
+    return (ElementType *)Malloc(sizeof(ElementType) * DequeBlockSize);
+}
+
+static void ReleaseBlock(ElementType *Block, Deque D)
+{
+    if (D->NumSpare < MaxSpareBlocks)
+        D->Spare[D->NumSpare++] = Block;
+    else
+        Free(Block);
+}
+
+// only block pointers move; the elements themselves stay where they are.
+// a map that is less than half used is just recentered
+static void GrowMap(Deque D)
+{
+    ElementType **NewMap;
+    int First, Used, Start, NewSize, i;
+
+    First = D->Front / DequeBlockSize;
+    Used = (D->Front + D->Size - 1) / DequeBlockSize - First + 1;
+    NewSize = (2 * Used < D->MapSize) ? D->MapSize : 2 * D->MapSize;
+    Start = (NewSize - Used) / 2;
+
+    NewMap = (ElementType **)Calloc(NewSize, sizeof(ElementType *));
+    for (i = 0; i < Used; i++)
+        NewMap[Start + i] = D->Map[First + i];
+    Free(D->Map);
+
+    D->Map = NewMap;
+    D->MapSize = NewSize;
+    D->Front = Start * DequeBlockSize + D->Front % DequeBlockSize;
+}
+
+static ElementType *Slot(int Index, Deque D)
+{
+    return &D->Map[Index / DequeBlockSize][Index % DequeBlockSize];
+}
+
+int IsEmpty(Deque D)
+{
+    return D->Size == 0;
+}
+
+// kept for the old fixed-size API; the block map grows on demand
+int IsFull(Deque D)
+{
+    (void)D;
+    return 0;
+}
+
+Deque CreateDeque(int MaxElemnts)
+{
+    Deque D;
+    int MapSize = MinDequeMapSize;
+
+    while (MapSize * DequeBlockSize < 2 * MaxElemnts)
+        MapSize *= 2;
+    D = (Deque)Malloc(sizeof(struct DequeRecord));
+    D->Map = (ElementType **)Calloc(MapSize, sizeof(ElementType *));
+    D->MapSize = MapSize;
+    D->NumSpare = 0;
+    D->Size = 0;
+    D->Front = MapSize / 2 * DequeBlockSize;
+    return D;
+}
+
+void DisposeDeque(Deque D)
+{
+    int i;
+    if (D != NULL)
+    {
+        for (i = 0; i < D->MapSize; i++)
+            Free(D->Map[i]);
+        for (i = 0; i < D->NumSpare; i++)
+            Free(D->Spare[i]);
+        Free(D->Map);
+        Free(D);
+    }
+}
+
+void MakeEmpty(Deque D)
+{
+    int i;
+    for (i = 0; i < D->MapSize; i++)
+        if (D->Map[i] != NULL)
+        {
+            ReleaseBlock(D->Map[i], D);
+            D->Map[i] = NULL;
+        }
+    D->Size = 0;
+    D->Front = D->MapSize / 2 * DequeBlockSize;
+}
+
+void Push(ElementType X, Deque D)
+{
+    if (D->Front == 0)
+        GrowMap(D);
+    D->Front--;
+    if (D->Map[D->Front / DequeBlockSize] == NULL)
+        D->Map[D->Front / DequeBlockSize] = AllocBlock(D);
+    *Slot(D->Front, D) = X;
+    D->Size++;
+}
+
+void Pop(Deque D)
+{
+    int Block;
+
+    if (IsEmpty(D))
+        runtime_error("Empty deque");
+    else
+    {
+        Block = D->Front / DequeBlockSize;
+        D->Size--;
+        D->Front++;
+        if (D->Size == 0 || D->Front % DequeBlockSize == 0)
+        {
+            ReleaseBlock(D->Map[Block], D);
+            D->Map[Block] = NULL;
+        }
+        if (D->Size == 0)
+            D->Front = D->MapSize / 2 * DequeBlockSize;
+    }
+}
+
+void Inject(ElementType X, Deque D)
+{
+    int Rear;
+
+    if (D->Front + D->Size == D->MapSize * DequeBlockSize)
+        GrowMap(D);
+    Rear = D->Front + D->Size;
+    if (D->Map[Rear / DequeBlockSize] == NULL)
+        D->Map[Rear / DequeBlockSize] = AllocBlock(D);
+    *Slot(Rear, D) = X;
+    D->Size++;
+}
+
+void Eject(Deque D)
+{
+    int Rear;
+
+    if (IsEmpty(D))
+        runtime_error("Empty deque");
+    else
+    {
+        Rear = D->Front + D->Size - 1;
+        D->Size--;
+        if (D->Size == 0 || Rear % DequeBlockSize == 0)
+        {
+            ReleaseBlock(D->Map[Rear / DequeBlockSize], D);
+            D->Map[Rear / DequeBlockSize] = NULL;
+        }
+        if (D->Size == 0)
+            D->Front = D->MapSize / 2 * DequeBlockSize;
+    }
+}
+
+ElementType Front(Deque D)
+{
+    if (IsEmpty(D))
+        runtime_error("Empty deque");
+    return *Slot(D->Front, D);
+}
+
+ElementType Rear(Deque D)
+{
+    if (IsEmpty(D))
+        runtime_error("Empty deque");
+    return *Slot(D->Front + D->Size - 1, D);
+}
+
+ElementType FrontAndPop(Deque D)
+{
+    if (IsEmpty(D))
+        runtime_error("Empty deque");
+    ElementType X = Front(D);
+    Pop(D);
+    return X;
+}
+
+ElementType RearAndEject(Deque D)
+{
+    if (IsEmpty(D))
+        runtime_error("Empty deque");
+    ElementType X = Rear(D);
+    Eject(D);
+    return X;
+}
+
+#endif
+
+#ifdef _WorkStealDeque_h
+
+static struct DequeArray *NewArray(long Capacity, struct DequeArray *Prev)
+{
+    struct DequeArray *A;
+    A = (struct DequeArray *)Malloc(sizeof(struct DequeArray));
+    A->Mask = Capacity - 1;
+    A->Prev = Prev;
+    A->Buffer = (_Atomic(ElementType) *)Malloc(sizeof(_Atomic(ElementType)) * Capacity);
+    return A;
+}
+
+// thieves may still read the old array, so it is kept until DisposeDeque
+static struct DequeArray *Grow(Deque D, struct DequeArray *A, long Bottom, long Top)
+{
+    struct DequeArray *NewA;
+    long i;
+
+    NewA = NewArray(2 * (A->Mask + 1), A);
+    for (i = Top; i < Bottom; i++)
+        atomic_store_explicit(&NewA->Buffer[i & NewA->Mask],
+                              atomic_load_explicit(&A->Buffer[i & A->Mask], memory_order_relaxed),
+                              memory_order_relaxed);
+    atomic_store_explicit(&D->Array, NewA, memory_order_release);
+    return NewA;
+}
+
+Deque CreateDeque(int MaxElements)
+{
+    Deque D;
+    long Capacity = 1;
+
+    if (MaxElements < MinDequeSize)
+        runtime_error("Deque size if too small");
+    while (Capacity < MaxElements)
+        Capacity <<= 1;
+    D = (Deque)Malloc(sizeof(struct DequeRecord));
+    atomic_init(&D->Top, 0);
+    atomic_init(&D->Bottom, 0);
+    atomic_init(&D->Array, NewArray(Capacity, NULL));
+    return D;
+}
+
+void DisposeDeque(Deque D)
+{
+    struct DequeArray *A, *Prev;
+
+    if (D != NULL)
+    {
+        for (A = atomic_load(&D->Array); A != NULL; A = Prev)
+        {
+            Prev = A->Prev;
+            Free(A->Buffer);
+            Free(A);
+        }
+        Free(D);
+    }
+}
+
+int IsEmpty(Deque D)
+{
+    return atomic_load(&D->Bottom) <= atomic_load(&D->Top);
+}
+
+// owner only
+void Push(ElementType X, Deque D)
+{
+    struct DequeArray *A;
+    long Bottom, Top;
+
+    Bottom = atomic_load_explicit(&D->Bottom, memory_order_relaxed);
+    Top = atomic_load_explicit(&D->Top, memory_order_acquire);
+    A = atomic_load_explicit(&D->Array, memory_order_relaxed);
+    if (Bottom - Top > A->Mask)
+        A = Grow(D, A, Bottom, Top);
+    atomic_store_explicit(&A->Buffer[Bottom & A->Mask], X, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&D->Bottom, Bottom + 1, memory_order_relaxed);
+}
+
+// owner only
+int Pop(ElementType *X, Deque D)
+{
+    struct DequeArray *A;
+    long Bottom, Top;
+    int Taken = 1;
+
+    Bottom = atomic_load_explicit(&D->Bottom, memory_order_relaxed) - 1;
+    A = atomic_load_explicit(&D->Array, memory_order_relaxed);
+    atomic_store_explicit(&D->Bottom, Bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    Top = atomic_load_explicit(&D->Top, memory_order_relaxed);
+
+    if (Top > Bottom)
+    {
+        atomic_store_explicit(&D->Bottom, Bottom + 1, memory_order_relaxed);
+        return 0;
+    }
+    *X = atomic_load_explicit(&A->Buffer[Bottom & A->Mask], memory_order_relaxed);
+    if (Top == Bottom)
+    {
+        // last element: race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&D->Top, &Top, Top + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed))
+            Taken = 0;
+        atomic_store_explicit(&D->Bottom, Bottom + 1, memory_order_relaxed);
+    }
+    return Taken;
+}
+
+// any thread; returns 0 when the deque is empty or another thread won the race
+int Steal(ElementType *X, Deque D)
+{
+    struct DequeArray *A;
+    long Bottom, Top;
+    ElementType Item;
+
+    Top = atomic_load_explicit(&D->Top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    Bottom = atomic_load_explicit(&D->Bottom, memory_order_acquire);
+    if (Top >= Bottom)
+        return 0;
+
+    A = atomic_load_explicit(&D->Array, memory_order_acquire);
+    Item = atomic_load_explicit(&A->Buffer[Top & A->Mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&D->Top, &Top, Top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+        return 0;
+    *X = Item;
+    return 1;
+}
+
+#endif
+
+#ifdef _TaskPool_H
+
+static _Thread_local struct Worker *CurrentWorker = NULL;
+
+static struct Task *FindTask(TaskPool P, struct Worker *W)
+{
+    struct Task *T = NULL;
+    int i, Victim;
+
+    if (W != NULL && Pop(&T, W->D))
+        return T;
+
+    pthread_mutex_lock(&P->Lock);
+    T = P->InjectFront;
+    if (T != NULL)
+    {
+        P->InjectFront = T->Next;
+        if (P->InjectFront == NULL)
+            P->InjectRear = NULL;
+    }
+    pthread_mutex_unlock(&P->Lock);
+    if (T != NULL)
+        return T;
+
+    Victim = W != NULL ? rand_r(&W->Seed) : 0;
+    for (i = 0; i < P->NumWorkers; i++)
+    {
+        struct Worker *V = &P->Workers[(Victim + i) % P->NumWorkers];
+        if (V != W && Steal(&T, V->D))
+            return T;
+    }
+    return NULL;
+}
+
+static void RunTask(struct Task *T)
+{
+    T->Func(T->Arg);
+    if (T->Pending != NULL)
+        atomic_fetch_sub(T->Pending, 1);
+    Free(T);
+}
+
+static void *WorkerLoop(void *Arg)
+{
+    struct Worker *W = (struct Worker *)Arg;
+    TaskPool P = W->Pool;
+    struct Task *T;
+
+    CurrentWorker = W;
+    while (!atomic_load(&P->Stop))
+    {
+        if ((T = FindTask(P, W)) != NULL)
+        {
+            atomic_fetch_sub(&P->NumQueued, 1);
+            RunTask(T);
+            continue;
+        }
+        pthread_mutex_lock(&P->Lock);
+        atomic_fetch_add(&P->NumSleeping, 1);
+        while (atomic_load(&P->NumQueued) == 0 && !atomic_load(&P->Stop))
+            pthread_cond_wait(&P->Wake, &P->Lock);
+        atomic_fetch_sub(&P->NumSleeping, 1);
+        pthread_mutex_unlock(&P->Lock);
+    }
+    return NULL;
+}
+
+TaskPool CreateTaskPool(int NumWorkers)
+{
+    TaskPool P;
+    int i;
+
+    if (NumWorkers < 1)
+        runtime_error("Task pool needs at least one worker");
+
+    P = (TaskPool)Malloc(sizeof(struct PoolRecord));
+    P->NumWorkers = NumWorkers;
+    P->Workers = (struct Worker *)Malloc(sizeof(struct Worker) * NumWorkers);
+    pthread_mutex_init(&P->Lock, NULL);
+    pthread_cond_init(&P->Wake, NULL);
+    P->InjectFront = P->InjectRear = NULL;
+    atomic_init(&P->NumQueued, 0);
+    atomic_init(&P->NumSleeping, 0);
+    atomic_init(&P->Stop, 0);
+
+    for (i = 0; i < NumWorkers; i++)
+    {
+        P->Workers[i].D = CreateDeque(64);
+        P->Workers[i].Pool = P;
+        P->Workers[i].Seed = i + 1;
+    }
+    for (i = 0; i < NumWorkers; i++)
+        if (pthread_create(&P->Workers[i].Thread, NULL, WorkerLoop, &P->Workers[i]) != 0)
+            unix_error("pthread_create error");
+    return P;
+}
+
+// tasks that were never started are dropped
+void DisposeTaskPool(TaskPool P)
+{
+    struct Task *T;
+    int i;
+
+    pthread_mutex_lock(&P->Lock);
+    atomic_store(&P->Stop, 1);
+    pthread_cond_broadcast(&P->Wake);
+    pthread_mutex_unlock(&P->Lock);
+
+    for (i = 0; i < P->NumWorkers; i++)
+        pthread_join(P->Workers[i].Thread, NULL);
+    for (i = 0; i < P->NumWorkers; i++)
+    {
+        while (Pop(&T, P->Workers[i].D))
+            Free(T);
+        DisposeDeque(P->Workers[i].D);
+    }
+    while ((T = P->InjectFront) != NULL)
+    {
+        P->InjectFront = T->Next;
+        Free(T);
+    }
+    pthread_mutex_destroy(&P->Lock);
+    pthread_cond_destroy(&P->Wake);
+    Free(P->Workers);
+    Free(P);
+}
+
+void Spawn(TaskFunction Func, void *Arg, atomic_int *Pending, TaskPool P)
+{
+    struct Task *T;
+
+    T = (struct Task *)Malloc(sizeof(struct Task));
+    T->Func = Func;
+    T->Arg = Arg;
+    T->Pending = Pending;
+    T->Next = NULL;
+    if (Pending != NULL)
+        atomic_fetch_add(Pending, 1);
+
+    if (CurrentWorker != NULL && CurrentWorker->Pool == P)
+        Push(T, CurrentWorker->D);
+    else
+    {
+        pthread_mutex_lock(&P->Lock);
+        if (P->InjectRear == NULL)
+            P->InjectFront = T;
+        else
+            P->InjectRear->Next = T;
+        P->InjectRear = T;
+        pthread_mutex_unlock(&P->Lock);
+    }
+
+    atomic_fetch_add(&P->NumQueued, 1);
+    if (atomic_load(&P->NumSleeping) > 0)
+    {
+        pthread_mutex_lock(&P->Lock);
+        pthread_cond_signal(&P->Wake);
+        pthread_mutex_unlock(&P->Lock);
+    }
+}
+
+// runs other tasks while waiting, so nested fork-join cannot deadlock
+void Wait(atomic_int *Pending, TaskPool P)
+{
+    struct Worker *W = (CurrentWorker != NULL && CurrentWorker->Pool == P) ? CurrentWorker : NULL;
+    struct Task *T;
+
+    while (atomic_load(Pending) > 0)
+    {
+        if ((T = FindTask(P, W)) != NULL)
+        {
+            atomic_fetch_sub(&P->NumQueued, 1);
+            RunTask(T);
+        }
+        else
+            sched_yield();
+    }
+}
+
+#endif
+
+#ifdef _Tree_H
+
+static SearchTree NewNode(ElementType X, SearchTree Left, SearchTree Right)
+{
+    SearchTree T = (SearchTree)Malloc(sizeof(struct TreeNode));
+    T->Element = X;
+#ifdef ValueType
+    memset(&T->Value, 0, sizeof(ValueType));
+#endif
+    T->Left = Left;
+    T->Right = Right;
+    return T;
+}
+
+static void DeleteNode(SearchTree T)
+{
+    Free(T);
+}
+
+SearchTree MakeEmpty(SearchTree T)
+{
+    if (T != NULL)
+    {
+        MakeEmpty(T->Left);
+        MakeEmpty(T->Right);
+        DeleteNode(T);
+    }
+    return NULL;
+}
+
+Position Find(ElementType X, SearchTree T)
+{
+    if (T == NULL)
+        return NULL;
+    if (X < T->Element)
+        return Find(X, T->Left);
+    else if (X > T->Element)
+        return Find(X, T->Right);
+    else
+        return T;
+}
+
+Position FindMin(SearchTree T)
+{
+    if (T == NULL)
+        return NULL;
+    else if (T->Left == NULL)
+        return T;
+    else
+        return FindMin(T->Left);
+}
+
+Position FindMax(SearchTree T)
+{
+    if (T == NULL)
+        return NULL;
+    else if (T->Right == NULL)
+        return T;
+    else
+        return FindMax(T->Right);
+}
+
+SearchTree Insert(ElementType X, SearchTree T)
+{
+    if (T == NULL)
+        T = NewNode(X, NULL, NULL);
+    else if (X < T->Element)
+        T->Left = Insert(X, T->Left);
+    else if (X > T->Element)
+        T->Right = Insert(X, T->Right);
+    return T;
+}
+
+SearchTree Delete(ElementType X, SearchTree T)
+{
+    Position TmpCell;
+
+    if (T == NULL)
+        runtime_error("Element not found");
+    else if (X < T->Element)
+        T->Left = Delete(X, T->Left);
+    else if (X > T->Element)
+        T->Right = Delete(X, T->Right);
+    else if (T->Left && T->Right)
+    {
+        TmpCell = FindMin(T->Right);
+        T->Element = TmpCell->Element;
+#ifdef ValueType
+        T->Value = TmpCell->Value;
+#endif
+        T->Right = Delete(T->Element, T->Right);
+    }
+    else
+    {
+        TmpCell = T;
+        if (T->Left == NULL)
+            T = T->Right;
+        else if (T->Right == NULL)
+            T = T->Left;
+        DeleteNode(TmpCell);
+    }
+    return T;
+}
+
+ElementType Retrieve(Position P)
+{
+    return P->Element;
+}
+
+Position FindPrev(ElementType X, SearchTree T)
+{
+    if (T == NULL)
+        runtime_error("Empty Tree");
+    Position P = NULL, N;
+    if (T->Element == X)
+        N = T->Left;
+    else if (T->Element < X)
+        N = T->Right;
+    else
+        N = T->Left;
+    if (N != NULL)
+    {
+        P = FindPrev(X, N);
+    }
+    if (T->Element < X)
+    {
+        if (P == NULL || P->Element < T->Element)
+            P = T;
+    }
+    return P;
+}
+
+Position FindNext(ElementType X, SearchTree T)
+{
+    if (T == NULL)
+        runtime_error("Empty Tree");
+    Position P = NULL, N;
+    if (T->Element == X)
+        N = T->Right;
+    else if (T->Element < X)
+        N = T->Right;
+    else
+        N = T->Left;
+    if (N != NULL)
+    {
+        P = FindNext(X, N);
+    }
+    if (T->Element > X)
+    {
+        if (P == NULL || P->Element > T->Element)
+            P = T;
+    }
+    return P;
+}
+
+static void IteratorPush(Position P, struct TreeIterator *I)
+{
+    if (I->Top + 1 == I->Capacity)
+    {
+        if (I->Stack == I->Inline)
+        {
+            I->Stack = (Position *)Malloc(sizeof(Position) * I->Capacity * 2);
+            memcpy(I->Stack, I->Inline, sizeof(Position) * I->Capacity);
+        }
+        else
+            I->Stack = (Position *)Realloc(I->Stack, sizeof(Position) * I->Capacity * 2);
+        I->Capacity *= 2;
+    }
+    I->Stack[++I->Top] = P;
+}
+
+static void PushLeft(Position P, struct TreeIterator *I)
+{
+    for (; P != NULL; P = P->Left)
+        IteratorPush(P, I);
+}
+
+Position IteratorFirst(SearchTree T, struct TreeIterator *I)
+{
+    I->Stack = I->Inline;
+    I->Capacity = TreeIteratorInline;
+    I->Top = -1;
+    PushLeft(T, I);
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+// positions I at the first element not less than X
+Position IteratorSeek(ElementType X, SearchTree T, struct TreeIterator *I)
+{
+    I->Stack = I->Inline;
+    I->Capacity = TreeIteratorInline;
+    I->Top = -1;
+    while (T != NULL)
+    {
+        if (T->Element < X)
+            T = T->Right;
+        else
+        {
+            IteratorPush(T, I);
+            T = T->Left;
+        }
+    }
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+// NULL once the iterator runs off the end
+Position IteratorNext(struct TreeIterator *I)
+{
+    if (I->Top < 0)
+        return NULL;
+    PushLeft(I->Stack[I->Top--]->Right, I);
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+void IteratorDispose(struct TreeIterator *I)
+{
+    if (I->Stack != I->Inline)
+        Free(I->Stack);
+    I->Stack = I->Inline;
+    I->Top = -1;
+}
+
+#ifdef ValueType
+// pointer to the value stored under Key, NULL if Key is absent
+ValueType *FindValue(ElementType Key, SearchTree T)
+{
+    while (T != NULL && Key != T->Element)
+    {
+        if (Key < T->Element)
+            T = T->Left;
+        else
+            T = T->Right;
+    }
+    return T == NULL ? NULL : &T->Value;
+}
+
+ValueType *InsertOrAssign(ElementType Key, ValueType Value, SearchTree *T)
+{
+    ValueType *V = Upsert(Key, T);
+    *V = Value;
+    return V;
+}
+
+// one descent: the existing value slot, or a zeroed one for a new key
+ValueType *Upsert(ElementType Key, SearchTree *T)
+{
+    SearchTree *Link = T;
+
+    while (*Link != NULL && Key != (*Link)->Element)
+    {
+        if (Key < (*Link)->Element)
+            Link = &(*Link)->Left;
+        else
+            Link = &(*Link)->Right;
+    }
+    if (*Link == NULL)
+        *Link = NewNode(Key, NULL, NULL);
+    return &(*Link)->Value;
+}
+#endif
+
+// calls Visit on every element in [Lo, Hi] in order
+void RangeScan(ElementType Lo, ElementType Hi, void (*Visit)(Position P, void *Arg), void *Arg, SearchTree T)
+{
+    struct TreeIterator I;
+    Position P;
+
+    for (P = IteratorSeek(Lo, T, &I); P != NULL && !(Hi < P->Element); P = IteratorNext(&I))
+        Visit(P, Arg);
+    IteratorDispose(&I);
+}
+
+#endif
+
+#ifdef _Tree_H_NR
+
+static SearchTree NewNode(ElementType X, SearchTree Left, SearchTree Right)
+{
+    SearchTree T = (SearchTree)Malloc(sizeof(struct TreeNode));
+    T->Element = X;
+    T->Left = Left;
+    T->Right = Right;
+    return T;
+}
+
+static void DeleteNode(SearchTree T)
+{
+    Free(T);
+}
+
+static void ModifyLine(Position P, LinkLine L)
+{
+    if (L != NULL)
+        *L = P;
+}
+
+SearchTree MakeEmpty(SearchTree T)
+{
+    if (T != NULL)
+    {
+        MakeEmpty(T->Left);
+        MakeEmpty(T->Right);
+        DeleteNode(T);
+    }
+    return NULL;
+}
+
+Position Find(ElementType X, SearchTree T)
+{
+    while (T != NULL)
+    {
+        if (T->Element > X)
+            T = T->Left;
+        else if (T->Element < X)
+            T = T->Right;
+        else
+            break;
+    }
+    return T;
+}
+
+Position FindMin(SearchTree T)
+{
+    if (T != NULL)
+        while (T->Left != NULL)
+            T = T->Left;
+    return T;
+}
+
+Position FindMax(SearchTree T)
+{
+    if (T != NULL)
+        while (T->Right != NULL)
+            T = T->Right;
+    return T;
+}
+
+void Insert(ElementType X, LinkLine LT)
+{
+    LinkLine L = LT;
+    SearchTree T = *LT;
+    while (T != NULL)
+    {
+        if (T->Element > X)
+        {
+            L = &(T->Left);
+            T = T->Left;
+        }
+        else if (T->Element < X)
+        {
+            L = &(T->Right);
+            T = T->Right;
+        }
+        else
+            break;
+    }
+    if (T == NULL)
+    {
+        T = NewNode(X, NULL, NULL);
+        ModifyLine(T, L);
+    }
+}
+
+static void DeleteSpecialTree(SearchTree T, LinkLine L)
+{
+    if (T->Left != NULL)
+        ModifyLine(T->Left, L);
+    else
+        ModifyLine(T->Right, L);
+    DeleteNode(T);
+}
+
+void Delete(ElementType X, LinkLine LT)
+{
+    SearchTree T = *LT;
+    LinkLine L = LT;
+    while (T != NULL)
+    {
+        if (T->Element < X)
+        {
+            L = &(T->Right);
+            T = T->Right;
+        }
+        else if (T->Element > X)
+        {
+            L = &(T->Left);
+            T = T->Left;
+        }
+        else
+            break;
+    }
+    if (T == NULL)
+        runtime_error("Element not found");
+    else
+    {
+        if (T->Left && T->Right)
+        {
+            SearchTree TP = T->Right;
+            LinkLine LP = &(T->Right);
+            while (TP->Left != NULL)
+            {
+                LP = &(TP->Left);
+                TP = TP->Left;
+            }
+            T->Element = TP->Element;
+            DeleteSpecialTree(TP, LP);
+        }
+        else
+            DeleteSpecialTree(T, L);
+    }
+}
+
+ElementType Retrieve(Position P)
+{
+    return P->Element;
+}
+
+Position FindPrev(ElementType X, SearchTree T)
+{
+    if (T == NULL)
+        runtime_error("Empty Tree");
+    Position P = NULL, N;
+    while (T != NULL)
+    {
+        if (T->Element < X)
+        {
+            if (P == NULL || P->Element < T->Element)
+                P = T;
+            T = T->Right;
+        }
+        else if (T->Element > X)
+            T = T->Left;
+        else
+            T = T->Left;
+    }
+    return P;
+}
+
+Position FindNext(ElementType X, SearchTree T)
+{
+    if (T == NULL)
+        runtime_error("Empty Tree");
+    Position P = NULL, N;
+    while (T != NULL)
+    {
+        if (T->Element < X)
+            T = T->Right;
+        else if (T->Element > X)
+        {
+            if (P == NULL || P->Element > T->Element)
+                P = T;
+            T = T->Left;
+        }
+        else
+            T = T->Right;
+    }
+    return P;
+}
+
+static void IteratorPush(Position P, struct TreeIterator *I)
+{
+    if (I->Top + 1 == I->Capacity)
+    {
+        if (I->Stack == I->Inline)
+        {
+            I->Stack = (Position *)Malloc(sizeof(Position) * I->Capacity * 2);
+            memcpy(I->Stack, I->Inline, sizeof(Position) * I->Capacity);
+        }
+        else
+            I->Stack = (Position *)Realloc(I->Stack, sizeof(Position) * I->Capacity * 2);
+        I->Capacity *= 2;
+    }
+    I->Stack[++I->Top] = P;
+}
+
+static void PushLeft(Position P, struct TreeIterator *I)
+{
+    for (; P != NULL; P = P->Left)
+        IteratorPush(P, I);
+}
+
+Position IteratorFirst(SearchTree T, struct TreeIterator *I)
+{
+    I->Stack = I->Inline;
+    I->Capacity = TreeIteratorInline;
+    I->Top = -1;
+    PushLeft(T, I);
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+// positions I at the first element not less than X
+Position IteratorSeek(ElementType X, SearchTree T, struct TreeIterator *I)
+{
+    I->Stack = I->Inline;
+    I->Capacity = TreeIteratorInline;
+    I->Top = -1;
+    while (T != NULL)
+    {
+        if (T->Element < X)
+            T = T->Right;
+        else
+        {
+            IteratorPush(T, I);
+            T = T->Left;
+        }
+    }
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+// NULL once the iterator runs off the end
+Position IteratorNext(struct TreeIterator *I)
+{
+    if (I->Top < 0)
+        return NULL;
+    PushLeft(I->Stack[I->Top--]->Right, I);
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+void IteratorDispose(struct TreeIterator *I)
+{
+    if (I->Stack != I->Inline)
+        Free(I->Stack);
+    I->Stack = I->Inline;
+    I->Top = -1;
+}
+
+// calls Visit on every element in [Lo, Hi] in order
+void RangeScan(ElementType Lo, ElementType Hi, void (*Visit)(Position P, void *Arg), void *Arg, SearchTree T)
+{
+    struct TreeIterator I;
+    Position P;
+
+    for (P = IteratorSeek(Lo, T, &I); P != NULL && !(Hi < P->Element); P = IteratorNext(&I))
+        Visit(P, Arg);
+    IteratorDispose(&I);
+}
+
+#endif
+
+#ifdef _AvlTree_H
+
+static AvlTree NewNode(ElementType X, AvlTree Left, AvlTree Right, int Height)
+{
+    AvlTree T = (AvlTree)Malloc(sizeof(struct AvlNode));
+    T->Element = X;
     T->Left = Left;
     T->Right = Right;
+    T->Height = Height;
+#ifdef ValueType
+    memset(&T->Value, 0, sizeof(ValueType));
+#endif
+#ifdef _AvlTree_Size
+    T->Size = 1 + GetSize(Left) + GetSize(Right);
+#endif
+    return T;
+}
+
+static void DeleteNode(AvlTree T)
+{
+    Free(T);
+}
+
+static int Max(int ValueA, int ValueB)
+{
+    if (ValueA > ValueB)
+        return ValueA;
+    else
+        return ValueB;
+}
+
+static Position SingleRotateWithLeft(Position K2)
+{
+    Position K1;
+
+    K1 = K2->Left;
+    K2->Left = K1->Right;
+    K1->Right = K2;
+
+    UpdateHeight(K2);
+    UpdateHeight(K1);
+    return K1;
+}
+
+static Position SingleRotateWithRight(Position K1)
+{
+    Position K2;
+
+    K2 = K1->Right;
+    K1->Right = K2->Left;
+    K2->Left = K1;
+
+    UpdateHeight(K1);
+    UpdateHeight(K2);
+    return K2;
+}
+
+static Position DoubleRotateWithLeft(Position K3)
+{
+    K3->Left = SingleRotateWithRight(K3->Left);
+
+    return SingleRotateWithLeft(K3);
+}
+
+static Position DoubleRotateWithRight(Position K1)
+{
+    K1->Right = SingleRotateWithLeft(K1->Right);
+
+    return SingleRotateWithRight(K1);
+}
+
+static int GetHeight(Position P)
+{
+    if (P == NULL)
+        return -1;
+    else
+        return P->Height;
+}
+
+static void UpdateHeight(Position P)
+{
+    if (P != NULL)
+        P->Height = Max(GetHeight(P->Left), GetHeight(P->Right)) + 1;
+#ifdef _AvlTree_Size
+    UpdateSize(P);
+#endif
+}
+
+#ifdef _AvlTree_Size
+static int GetSize(Position P)
+{
+    if (P == NULL)
+        return 0;
+    else
+        return P->Size;
+}
+
+static void UpdateSize(Position P)
+{
+    if (P != NULL)
+        P->Size = GetSize(P->Left) + GetSize(P->Right) + 1;
+}
+
+static int CountBelow(ElementType X, int OrEqual, AvlTree T)
+{
+    int N = 0;
+    while (T != NULL)
+    {
+        if (ElementLess(T->Element, X) || (OrEqual && ElementEqual(T->Element, X)))
+        {
+            N += GetSize(T->Left) + 1;
+            T = T->Right;
+        }
+        else
+            T = T->Left;
+    }
+    return N;
+}
+#endif
+
+static AvlTree TryRotate(AvlTree T)
+{
+    if (GetHeight(T->Right) - GetHeight(T->Left) == 2)
+    {
+        if (GetHeight(T->Right->Right) >= GetHeight(T->Right->Left))
+            T = SingleRotateWithRight(T);
+        else
+            T = DoubleRotateWithRight(T);
+    }
+    else if (GetHeight(T->Left) - GetHeight(T->Right) == 2)
+    {
+        if (GetHeight(T->Left->Left) >= GetHeight(T->Left->Right))
+            T = SingleRotateWithLeft(T);
+        else
+            T = DoubleRotateWithLeft(T);
+    }
+    return T;
+}
+
+// walks back up the recorded path, stopping once a subtree keeps its height
+static void Rebalance(AvlTree *Path[], int Depth)
+{
+    AvlTree T;
+    int OldHeight;
+
+    while (Depth-- > 0)
+    {
+        T = *Path[Depth];
+        OldHeight = T->Height;
+        T = TryRotate(T);
+        UpdateHeight(T);
+        *Path[Depth] = T;
+        if (T->Height == OldHeight)
+            break;
+    }
+#ifdef _AvlTree_Size
+    // the heights above are settled, the sizes are not
+    while (Depth-- > 0)
+        UpdateSize(*Path[Depth]);
+#endif
+}
+
+// rotates left children up so every node is freed with an empty left subtree
+AvlTree MakeEmpty(AvlTree T)
+{
+    Position L, R;
+    while (T != NULL)
+    {
+        if (T->Left != NULL)
+        {
+            L = T->Left;
+            T->Left = L->Right;
+            L->Right = T;
+            T = L;
+        }
+        else
+        {
+            R = T->Right;
+            DeleteNode(T);
+            T = R;
+        }
+    }
+    return NULL;
+}
+
+Position Find(ElementType X, AvlTree T)
+{
+    while (T != NULL && !ElementEqual(X, T->Element))
+    {
+        if (ElementLess(X, T->Element))
+            T = T->Left;
+        else
+            T = T->Right;
+    }
+    return T;
+}
+
+Position FindMin(AvlTree T)
+{
+    if (T != NULL)
+        while (T->Left != NULL)
+            T = T->Left;
+    return T;
+}
+
+Position FindMax(AvlTree T)
+{
+    if (T != NULL)
+        while (T->Right != NULL)
+            T = T->Right;
+    return T;
+}
+
+// the node holding X, inserted if it was missing
+static Position InsertNode(ElementType X, AvlTree *T)
+{
+    AvlTree *Path[AvlMaxDepth], *Link = T;
+    Position P;
+    int Depth = 0;
+
+    while (*Link != NULL)
+    {
+        if (ElementLess(X, (*Link)->Element))
+        {
+            Path[Depth++] = Link;
+            Link = &(*Link)->Left;
+        }
+        else if (ElementLess((*Link)->Element, X))
+        {
+            Path[Depth++] = Link;
+            Link = &(*Link)->Right;
+        }
+        else
+            return *Link;
+    }
+    P = *Link = NewNode(X, NULL, NULL, 0);
+    Rebalance(Path, Depth);
+    return P;
+}
+
+AvlTree Insert(ElementType X, AvlTree T)
+{
+    InsertNode(X, &T);
+    return T;
+}
+
+AvlTree Delete(ElementType X, AvlTree T)
+{
+    AvlTree *Path[AvlMaxDepth], *Link = &T;
+    Position TmpCell;
+    int Depth = 0;
+
+    while (*Link != NULL && !ElementEqual(X, (*Link)->Element))
+    {
+        Path[Depth++] = Link;
+        if (ElementLess(X, (*Link)->Element))
+            Link = &(*Link)->Left;
+        else
+            Link = &(*Link)->Right;
+    }
+    if (*Link == NULL)
+        runtime_error("Element not found");
+
+    TmpCell = *Link;
+    if (TmpCell->Left && TmpCell->Right)
+    {
+        Path[Depth++] = Link;
+        Link = &TmpCell->Right;
+        while ((*Link)->Left != NULL)
+        {
+            Path[Depth++] = Link;
+            Link = &(*Link)->Left;
+        }
+        TmpCell->Element = (*Link)->Element;
+#ifdef ValueType
+        TmpCell->Value = (*Link)->Value;
+#endif
+        TmpCell = *Link;
+    }
+    if (TmpCell->Left == NULL)
+        *Link = TmpCell->Right;
+    else
+        *Link = TmpCell->Left;
+    DeleteNode(TmpCell);
+    Rebalance(Path, Depth);
+    return T;
+}
+
+ElementType Retrieve(Position P)
+{
+    return P->Element;
+}
+
+Position FindPrev(ElementType X, AvlTree T)
+{
+    Position P = NULL;
+    if (T == NULL)
+        runtime_error("Empty Tree");
+    while (T != NULL)
+    {
+        if (ElementLess(T->Element, X))
+        {
+            P = T;
+            T = T->Right;
+        }
+        else
+            T = T->Left;
+    }
+    return P;
+}
+
+Position FindNext(ElementType X, AvlTree T)
+{
+    Position P = NULL;
+    if (T == NULL)
+        runtime_error("Empty Tree");
+    while (T != NULL)
+    {
+        if (ElementLess(X, T->Element))
+        {
+            P = T;
+            T = T->Left;
+        }
+        else
+            T = T->Right;
+    }
+    return P;
+}
+
+static AvlTree BuildRange(ElementType A[], int Lo, int Hi)
+{
+    int Mid;
+    AvlTree T;
+
+    if (Lo > Hi)
+        return NULL;
+    Mid = Lo + (Hi - Lo) / 2;
+    T = NewNode(A[Mid], BuildRange(A, Lo, Mid - 1), BuildRange(A, Mid + 1, Hi), 0);
+    UpdateHeight(T);
+    return T;
+}
+
+// A must be strictly increasing
+AvlTree BuildFromSorted(ElementType A[], int N)
+{
+    return BuildRange(A, 0, N - 1);
+}
+
+// L is more than one level higher than R: hang K on L's right spine
+static AvlTree JoinRight(AvlTree L, Position K, AvlTree R)
+{
+    AvlTree *Path[AvlMaxDepth], *Link = &L;
+    int Depth = 0;
+
+    while (GetHeight(*Link) > GetHeight(R) + 1)
+    {
+        Path[Depth++] = Link;
+        Link = &(*Link)->Right;
+    }
+    K->Left = *Link;
+    K->Right = R;
+    UpdateHeight(K);
+    *Link = K;
+    Rebalance(Path, Depth);
+    return L;
+}
+
+static AvlTree JoinLeft(AvlTree L, Position K, AvlTree R)
+{
+    AvlTree *Path[AvlMaxDepth], *Link = &R;
+    int Depth = 0;
+
+    while (GetHeight(*Link) > GetHeight(L) + 1)
+    {
+        Path[Depth++] = Link;
+        Link = &(*Link)->Left;
+    }
+    K->Left = L;
+    K->Right = *Link;
+    UpdateHeight(K);
+    *Link = K;
+    Rebalance(Path, Depth);
+    return R;
+}
+
+// every element of L < K's element < every element of R, O(|height difference|)
+AvlTree JoinNode(AvlTree L, Position K, AvlTree R)
+{
+    if (GetHeight(L) > GetHeight(R) + 1)
+        return JoinRight(L, K, R);
+    if (GetHeight(R) > GetHeight(L) + 1)
+        return JoinLeft(L, K, R);
+    K->Left = L;
+    K->Right = R;
+    UpdateHeight(K);
+    return K;
+}
+
+static AvlTree DetachMin(AvlTree T, Position *Min)
+{
+    AvlTree *Path[AvlMaxDepth], *Link = &T;
+    int Depth = 0;
+
+    while ((*Link)->Left != NULL)
+    {
+        Path[Depth++] = Link;
+        Link = &(*Link)->Left;
+    }
+    *Min = *Link;
+    *Link = (*Link)->Right;
+    Rebalance(Path, Depth);
+    return T;
+}
+
+// every element of L < every element of R
+AvlTree Join(AvlTree L, AvlTree R)
+{
+    Position K;
+    if (R == NULL)
+        return L;
+    R = DetachMin(R, &K);
+    return JoinNode(L, K, R);
+}
+
+// splits T into the elements below and above X; X's own node is freed
+int Split(ElementType X, AvlTree T, AvlTree *L, AvlTree *R)
+{
+    Position Path[AvlMaxDepth];
+    int Depth = 0, Found = 0;
+    AvlTree Left = NULL, Right = NULL;
+
+    while (T != NULL && !ElementEqual(X, T->Element))
+    {
+        Path[Depth++] = T;
+        if (ElementLess(X, T->Element))
+            T = T->Left;
+        else
+            T = T->Right;
+    }
+    if (T != NULL)
+    {
+        Left = T->Left;
+        Right = T->Right;
+        DeleteNode(T);
+        Found = 1;
+    }
+    while (Depth-- > 0)
+    {
+        T = Path[Depth];
+        if (ElementLess(X, T->Element))
+            Right = JoinNode(Right, T, T->Right);
+        else
+            Left = JoinNode(T->Left, T, Left);
+    }
+    *L = Left;
+    *R = Right;
+    return Found;
+}
+
+#ifdef _AvlTree_Parallel
+static void *SetOpThread(void *Arg)
+{
+    struct SetOpArgs *A = (struct SetOpArgs *)Arg;
+    A->Result = SetOp(A->T1, A->T2, A->Op, A->Depth);
+    return NULL;
+}
+#endif
+
+// splits T2 at T1's root and recurses on both sides; consumes T1 and T2
+static AvlTree SetOp(AvlTree T1, AvlTree T2, int Op, int Depth)
+{
+    AvlTree L1, R1, L2, R2, Left, Right;
+    int Found;
+
+    if (T1 == NULL)
+    {
+        if (Op == AvlUnion)
+            return T2;
+        return MakeEmpty(T2);
+    }
+    if (T2 == NULL)
+    {
+        if (Op == AvlIntersection)
+            return MakeEmpty(T1);
+        return T1;
+    }
+
+    L1 = T1->Left;
+    R1 = T1->Right;
+    Found = Split(T1->Element, T2, &L2, &R2);
+#ifdef _AvlTree_Parallel
+    pthread_t Thread;
+    struct SetOpArgs Args = {L1, L2, NULL, Op, Depth + 1};
+    if (Depth < AvlParallelDepth && GetHeight(T1) >= AvlParallelHeight &&
+        pthread_create(&Thread, NULL, SetOpThread, &Args) == 0)
+    {
+        Right = SetOp(R1, R2, Op, Depth + 1);
+        pthread_join(Thread, NULL);
+        Left = Args.Result;
+    }
+    else
+#endif
+    {
+        Left = SetOp(L1, L2, Op, Depth + 1);
+        Right = SetOp(R1, R2, Op, Depth + 1);
+    }
+
+    if (Op == AvlUnion || (Op == AvlIntersection && Found) || (Op == AvlDifference && !Found))
+        return JoinNode(Left, T1, Right);
+    DeleteNode(T1);
+    return Join(Left, Right);
+}
+
+AvlTree Union(AvlTree T1, AvlTree T2)
+{
+    return SetOp(T1, T2, AvlUnion, 0);
+}
+
+AvlTree Intersection(AvlTree T1, AvlTree T2)
+{
+    return SetOp(T1, T2, AvlIntersection, 0);
+}
+
+// the elements of T1 that are not in T2
+AvlTree Difference(AvlTree T1, AvlTree T2)
+{
+    return SetOp(T1, T2, AvlDifference, 0);
+}
+
+#ifdef ValueType
+// pointer to the value stored under Key, NULL if Key is absent
+ValueType *FindValue(ElementType Key, AvlTree T)
+{
+    Position P = Find(Key, T);
+    return P == NULL ? NULL : &P->Value;
+}
+
+ValueType *InsertOrAssign(ElementType Key, ValueType Value, AvlTree *T)
+{
+    ValueType *V = Upsert(Key, T);
+    *V = Value;
+    return V;
+}
+
+// one descent: the existing value slot, or a zeroed one for a new key;
+// rotations move links, not nodes, so the pointer stays valid
+ValueType *Upsert(ElementType Key, AvlTree *T)
+{
+    return &InsertNode(Key, T)->Value;
+}
+#endif
+
+Position IteratorFirst(AvlTree T, struct AvlIterator *I)
+{
+    I->Top = -1;
+    for (; T != NULL; T = T->Left)
+        I->Stack[++I->Top] = T;
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+// positions I at the first element not less than X
+Position IteratorSeek(ElementType X, AvlTree T, struct AvlIterator *I)
+{
+    I->Top = -1;
+    while (T != NULL)
+    {
+        if (ElementLess(T->Element, X))
+            T = T->Right;
+        else
+        {
+            I->Stack[++I->Top] = T;
+            T = T->Left;
+        }
+    }
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+// NULL once the iterator runs off the end
+Position IteratorNext(struct AvlIterator *I)
+{
+    Position P;
+    if (I->Top < 0)
+        return NULL;
+    for (P = I->Stack[I->Top--]->Right; P != NULL; P = P->Left)
+        I->Stack[++I->Top] = P;
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+// calls Visit on every element in [Lo, Hi] in order
+void RangeScan(ElementType Lo, ElementType Hi, void (*Visit)(Position P, void *Arg), void *Arg, AvlTree T)
+{
+    struct AvlIterator I;
+    Position P;
+
+    for (P = IteratorSeek(Lo, T, &I); P != NULL && !ElementLess(Hi, P->Element); P = IteratorNext(&I))
+        Visit(P, Arg);
+}
+
+#ifdef _AvlTree_Size
+// number of elements less than X
+int Rank(ElementType X, AvlTree T)
+{
+    return CountBelow(X, 0, T);
+}
+
+// the K-th smallest element, counting from 1
+Position Select(int K, AvlTree T)
+{
+    while (T != NULL)
+    {
+        if (K <= GetSize(T->Left))
+            T = T->Left;
+        else if (K == GetSize(T->Left) + 1)
+            return T;
+        else
+        {
+            K -= GetSize(T->Left) + 1;
+            T = T->Right;
+        }
+    }
+    return NULL;
+}
+
+// number of elements in [Lo, Hi]
+int CountRange(ElementType Lo, ElementType Hi, AvlTree T)
+{
+    if (ElementLess(Hi, Lo))
+        return 0;
+    return CountBelow(Hi, 1, T) - CountBelow(Lo, 0, T);
+}
+#endif
+
+#endif
+
+#ifdef _CompactAvl_H
+
+static Position NewNode(ElementType X, AvlTree T)
+{
+    Position P;
+    if (T->FreeList != 0)
+    {
+        P = T->FreeList;
+        T->FreeList = T->Nodes[P].Right;
+    }
+    else
+    {
+        if (T->Top == T->Capacity)
+        {
+            if (T->Capacity == MaxAvlPoolSize)
+                runtime_error("Out of space!!!");
+            T->Capacity *= 2;
+            T->Nodes = (struct AvlNode *)Realloc(T->Nodes, sizeof(struct AvlNode) * T->Capacity);
+        }
+        P = T->Top++;
+    }
+    T->Nodes[P].Element = X;
+    T->Nodes[P].Left = 1;
+    T->Nodes[P].Right = 0;
+    return P;
+}
+
+static void DeleteNode(Position P, AvlTree T)
+{
+    T->Nodes[P].Right = T->FreeList;
+    T->FreeList = P;
+}
+
+static Position GetLeft(Position P, AvlTree T)
+{
+    return T->Nodes[P].Left >> 2;
+}
+
+static Position GetRight(Position P, AvlTree T)
+{
+    return T->Nodes[P].Right;
+}
+
+static int GetBalance(Position P, AvlTree T)
+{
+    return (int)(T->Nodes[P].Left & 3) - 1;
+}
+
+static void SetLeft(Position P, Position C, AvlTree T)
+{
+    T->Nodes[P].Left = (C << 2) | (T->Nodes[P].Left & 3);
+}
+
+static void SetRight(Position P, Position C, AvlTree T)
+{
+    T->Nodes[P].Right = C;
+}
+
+static void SetBalance(Position P, int B, AvlTree T)
+{
+    T->Nodes[P].Left = (T->Nodes[P].Left & ~3u) | (unsigned int)(B + 1);
+}
+
+// replaces the child reached from Path[Depth - 1], or the root
+static void SetChild(Position Path[], int Dir[], int Depth, Position C, AvlTree T)
+{
+    if (Depth == 0)
+        T->Root = C;
+    else if (Dir[Depth - 1])
+        SetRight(Path[Depth - 1], C, T);
+    else
+        SetLeft(Path[Depth - 1], C, T);
+}
+
+static Position RotateWithLeft(Position P, AvlTree T)
+{
+    Position L = GetLeft(P, T);
+    SetLeft(P, GetRight(L, T), T);
+    SetRight(L, P, T);
+    return L;
+}
+
+static Position RotateWithRight(Position P, AvlTree T)
+{
+    Position R = GetRight(P, T);
+    SetRight(P, GetLeft(R, T), T);
+    SetLeft(R, P, T);
+    return R;
+}
+
+// B is P's balance of +-2, which does not fit in the node; returns the
+// new subtree root and whether the subtree got lower
+static Position FixBalance(Position P, int B, int *Shrunk, AvlTree T)
+{
+    Position C, G;
+    int BC, BG;
+
+    if (B > 0)
+    {
+        C = GetRight(P, T);
+        BC = GetBalance(C, T);
+        if (BC >= 0)
+        {
+            SetBalance(P, 1 - BC, T);
+            SetBalance(C, BC - 1, T);
+            *Shrunk = BC != 0;
+            return RotateWithRight(P, T);
+        }
+        G = GetLeft(C, T);
+        BG = GetBalance(G, T);
+        SetRight(P, RotateWithLeft(C, T), T);
+        G = RotateWithRight(P, T);
+        SetBalance(P, BG > 0 ? -1 : 0, T);
+        SetBalance(C, BG < 0 ? 1 : 0, T);
+    }
+    else
+    {
+        C = GetLeft(P, T);
+        BC = GetBalance(C, T);
+        if (BC <= 0)
+        {
+            SetBalance(P, -1 - BC, T);
+            SetBalance(C, BC + 1, T);
+            *Shrunk = BC != 0;
+            return RotateWithLeft(P, T);
+        }
+        G = GetRight(C, T);
+        BG = GetBalance(G, T);
+        SetLeft(P, RotateWithRight(C, T), T);
+        G = RotateWithLeft(P, T);
+        SetBalance(P, BG < 0 ? 1 : 0, T);
+        SetBalance(C, BG > 0 ? -1 : 0, T);
+    }
+    SetBalance(G, 0, T);
+    *Shrunk = 1;
+    return G;
+}
+
+AvlTree CreateTree(void)
+{
+    AvlTree T;
+    T = (AvlTree)Malloc(sizeof(struct AvlTreeRecord));
+    T->Capacity = MinAvlPoolSize;
+    T->Nodes = (struct AvlNode *)Malloc(sizeof(struct AvlNode) * T->Capacity);
+    return MakeEmpty(T);
+}
+
+void DisposeTree(AvlTree T)
+{
+    if (T != NULL)
+    {
+        Free(T->Nodes);
+        Free(T);
+    }
+}
+
+// keeps the pool
+AvlTree MakeEmpty(AvlTree T)
+{
+    T->Top = 1;
+    T->FreeList = 0;
+    T->Root = 0;
+    return T;
+}
+
+Position Find(ElementType X, AvlTree T)
+{
+    Position P = T->Root;
+    while (P != 0 && X != T->Nodes[P].Element)
+    {
+        if (X < T->Nodes[P].Element)
+            P = GetLeft(P, T);
+        else
+            P = GetRight(P, T);
+    }
+    return P;
+}
+
+Position FindMin(AvlTree T)
+{
+    Position P = T->Root;
+    if (P != 0)
+        while (GetLeft(P, T) != 0)
+            P = GetLeft(P, T);
+    return P;
+}
+
+Position FindMax(AvlTree T)
+{
+    Position P = T->Root;
+    if (P != 0)
+        while (GetRight(P, T) != 0)
+            P = GetRight(P, T);
+    return P;
+}
+
+AvlTree Insert(ElementType X, AvlTree T)
+{
+    Position Path[AvlMaxDepth], P = T->Root;
+    int Dir[AvlMaxDepth], Depth = 0, B, Shrunk;
+
+    while (P != 0)
+    {
+        if (X < T->Nodes[P].Element)
+            Dir[Depth] = 0;
+        else if (X > T->Nodes[P].Element)
+            Dir[Depth] = 1;
+        else
+            return T;
+        Path[Depth] = P;
+        P = Dir[Depth++] ? GetRight(P, T) : GetLeft(P, T);
+    }
+    SetChild(Path, Dir, Depth, NewNode(X, T), T);
+
+    // climb while subtrees grow; a rotation always restores the old height
+    while (Depth-- > 0)
+    {
+        P = Path[Depth];
+        B = GetBalance(P, T) + (Dir[Depth] ? 1 : -1);
+        if (B == 0)
+        {
+            SetBalance(P, 0, T);
+            break;
+        }
+        if (B == 1 || B == -1)
+        {
+            SetBalance(P, B, T);
+            continue;
+        }
+        SetChild(Path, Dir, Depth, FixBalance(P, B, &Shrunk, T), T);
+        break;
+    }
+    return T;
+}
+
+AvlTree Delete(ElementType X, AvlTree T)
+{
+    Position Path[AvlMaxDepth], P = T->Root, TmpCell;
+    int Dir[AvlMaxDepth], Depth = 0, B, Shrunk;
+
+    while (P != 0 && X != T->Nodes[P].Element)
+    {
+        Path[Depth] = P;
+        Dir[Depth] = X > T->Nodes[P].Element;
+        P = Dir[Depth++] ? GetRight(P, T) : GetLeft(P, T);
+    }
+    if (P == 0)
+        runtime_error("Element not found");
+
+    if (GetLeft(P, T) != 0 && GetRight(P, T) != 0)
+    {
+        TmpCell = P;
+        Path[Depth] = P;
+        Dir[Depth++] = 1;
+        P = GetRight(P, T);
+        while (GetLeft(P, T) != 0)
+        {
+            Path[Depth] = P;
+            Dir[Depth++] = 0;
+            P = GetLeft(P, T);
+        }
+        T->Nodes[TmpCell].Element = T->Nodes[P].Element;
+    }
+    SetChild(Path, Dir, Depth, GetLeft(P, T) != 0 ? GetLeft(P, T) : GetRight(P, T), T);
+    DeleteNode(P, T);
+
+    // climb while subtrees shrink
+    while (Depth-- > 0)
+    {
+        P = Path[Depth];
+        B = GetBalance(P, T) + (Dir[Depth] ? -1 : 1);
+        if (B == 1 || B == -1)
+        {
+            SetBalance(P, B, T);
+            break;
+        }
+        if (B == 0)
+        {
+            SetBalance(P, 0, T);
+            continue;
+        }
+        SetChild(Path, Dir, Depth, FixBalance(P, B, &Shrunk, T), T);
+        if (!Shrunk)
+            break;
+    }
     return T;
 }
 
-static void DeleteNode(SearchTree T)
+ElementType Retrieve(Position P, AvlTree T)
+{
+    return T->Nodes[P].Element;
+}
+
+Position FindPrev(ElementType X, AvlTree T)
+{
+    Position P = 0, N = T->Root;
+    if (N == 0)
+        runtime_error("Empty Tree");
+    while (N != 0)
+    {
+        if (T->Nodes[N].Element < X)
+        {
+            P = N;
+            N = GetRight(N, T);
+        }
+        else
+            N = GetLeft(N, T);
+    }
+    return P;
+}
+
+Position FindNext(ElementType X, AvlTree T)
+{
+    Position P = 0, N = T->Root;
+    if (N == 0)
+        runtime_error("Empty Tree");
+    while (N != 0)
+    {
+        if (T->Nodes[N].Element > X)
+        {
+            P = N;
+            N = GetLeft(N, T);
+        }
+        else
+            N = GetRight(N, T);
+    }
+    return P;
+}
+
+#endif
+
+#ifdef _PersistentAvl_H
+
+static Position NewNode(ElementType X, AvlTree Left, AvlTree Right, PersistentAvl T)
+{
+    Position P = (Position)Malloc(sizeof(struct AvlNode));
+    P->Element = X;
+    P->Left = Left;
+    P->Right = Right;
+    P->Version = T->Version;
+    P->Retired = NULL;
+    UpdateHeight(P);
+    return P;
+}
+
+static void DeleteNode(Position P)
+{
+    Free(P);
+}
+
+// old readers may still be walking P, so it only goes to the pending list
+static void Retire(Position P, PersistentAvl T)
+{
+    P->Retired = T->Pending;
+    T->Pending = P;
+}
+
+static void FreeLimbo(int i, PersistentAvl T)
+{
+    Position P, PN;
+    for (P = T->Limbo[i]; P != NULL; P = PN)
+    {
+        PN = P->Retired;
+        DeleteNode(P);
+    }
+    T->Limbo[i] = NULL;
+}
+
+static void TryAdvance(PersistentAvl T)
+{
+    unsigned int Epoch = atomic_load(&T->GlobalEpoch), State;
+    ReaderHandle R;
+
+    for (R = atomic_load_explicit(&T->Readers, memory_order_acquire); R != NULL; R = R->Next)
+    {
+        State = atomic_load(&R->State);
+        if ((State & 1) && (State >> 1) != Epoch)
+            return;
+    }
+    atomic_compare_exchange_strong(&T->GlobalEpoch, &Epoch, Epoch + 1);
+}
+
+// a private copy of P that the current update may modify
+static Position Own(Position P, PersistentAvl T)
+{
+    Position Q;
+    if (P == NULL || P->Version == T->Version)
+        return P;
+    Q = NewNode(P->Element, P->Left, P->Right, T);
+    Retire(P, T);
+    return Q;
+}
+
+static int Max(int ValueA, int ValueB)
+{
+    if (ValueA > ValueB)
+        return ValueA;
+    else
+        return ValueB;
+}
+
+static int GetHeight(Position P)
 {
-    Free(T);
+    if (P == NULL)
+        return -1;
+    else
+        return P->Height;
 }
 
-SearchTree MakeEmpty(SearchTree T)
+static void UpdateHeight(Position P)
 {
-    if (T != NULL)
+    P->Height = Max(GetHeight(P->Left), GetHeight(P->Right)) + 1;
+}
+
+static Position RotateWithLeft(Position K2, PersistentAvl T)
+{
+    Position K1;
+
+    K1 = Own(K2->Left, T);
+    K2->Left = K1->Right;
+    K1->Right = K2;
+
+    UpdateHeight(K2);
+    UpdateHeight(K1);
+    return K1;
+}
+
+static Position RotateWithRight(Position K1, PersistentAvl T)
+{
+    Position K2;
+
+    K2 = Own(K1->Right, T);
+    K1->Right = K2->Left;
+    K2->Left = K1;
+
+    UpdateHeight(K1);
+    UpdateHeight(K2);
+    return K2;
+}
+
+// N is already owned
+static AvlTree TryRotate(AvlTree N, PersistentAvl T)
+{
+    if (GetHeight(N->Right) - GetHeight(N->Left) == 2)
     {
-        MakeEmpty(T->Left);
-        MakeEmpty(T->Right);
-        DeleteNode(T);
+        if (GetHeight(N->Right->Right) < GetHeight(N->Right->Left))
+            N->Right = RotateWithLeft(Own(N->Right, T), T);
+        N = RotateWithRight(N, T);
     }
-    return NULL;
+    else if (GetHeight(N->Left) - GetHeight(N->Right) == 2)
+    {
+        if (GetHeight(N->Left->Left) < GetHeight(N->Left->Right))
+            N->Left = RotateWithRight(Own(N->Left, T), T);
+        N = RotateWithLeft(N, T);
+    }
+    else
+        UpdateHeight(N);
+    return N;
 }
 
-Position Find(ElementType X, SearchTree T)
+// X must not be in N
+static AvlTree InsertCopy(ElementType X, AvlTree N, PersistentAvl T)
 {
-    if (T == NULL)
-        return NULL;
-    if (X < T->Element)
-        return Find(X, T->Left);
-    else if (X > T->Element)
-        return Find(X, T->Right);
+    if (N == NULL)
+        return NewNode(X, NULL, NULL, T);
+    N = Own(N, T);
+    if (X < N->Element)
+        N->Left = InsertCopy(X, N->Left, T);
     else
-        return T;
+        N->Right = InsertCopy(X, N->Right, T);
+    return TryRotate(N, T);
 }
 
-Position FindMin(SearchTree T)
+static AvlTree DeleteMinCopy(AvlTree N, Position *Min, PersistentAvl T)
 {
-    if (T == NULL)
-        return NULL;
-    else if (T->Left == NULL)
-        return T;
-    else
-        return FindMin(T->Left);
+    if (N->Left == NULL)
+    {
+        *Min = N;
+        return N->Right;
+    }
+    N = Own(N, T);
+    N->Left = DeleteMinCopy(N->Left, Min, T);
+    return TryRotate(N, T);
 }
 
-Position FindMax(SearchTree T)
+// X must be in N
+static AvlTree DeleteCopy(ElementType X, AvlTree N, PersistentAvl T)
 {
-    if (T == NULL)
-        return NULL;
-    else if (T->Right == NULL)
-        return T;
+    Position Min;
+    AvlTree Right;
+
+    if (X == N->Element)
+    {
+        Retire(N, T);
+        if (N->Left == NULL)
+            return N->Right;
+        if (N->Right == NULL)
+            return N->Left;
+        Right = DeleteMinCopy(N->Right, &Min, T);
+        Min = Own(Min, T);
+        Min->Left = N->Left;
+        Min->Right = Right;
+        return TryRotate(Min, T);
+    }
+    N = Own(N, T);
+    if (X < N->Element)
+        N->Left = DeleteCopy(X, N->Left, T);
     else
-        return FindMax(T->Right);
+        N->Right = DeleteCopy(X, N->Right, T);
+    return TryRotate(N, T);
 }
 
-SearchTree Insert(ElementType X, SearchTree T)
+PersistentAvl CreateTree(void)
 {
-    if (T == NULL)
-        T = NewNode(X, NULL, NULL);
-    else if (X < T->Element)
-        T->Left = Insert(X, T->Left);
-    else if (X > T->Element)
-        T->Right = Insert(X, T->Right);
+    PersistentAvl T;
+    int i;
+
+    T = (PersistentAvl)Malloc(sizeof(struct PersistentAvlRecord));
+    atomic_init(&T->Root, NULL);
+    pthread_mutex_init(&T->WriteLock, NULL);
+    T->Version = 0;
+    atomic_init(&T->GlobalEpoch, 0);
+    atomic_init(&T->Readers, NULL);
+    T->Pending = NULL;
+    for (i = 0; i < 3; i++)
+    {
+        T->Limbo[i] = NULL;
+        T->LimboEpoch[i] = 0;
+    }
     return T;
 }
 
-SearchTree Delete(ElementType X, SearchTree T)
+// no reader or writer may use the tree any more
+void DisposeTree(PersistentAvl T)
 {
-    Position TmpCell;
+    Position P = atomic_load(&T->Root), L;
+    ReaderHandle R, RN;
+    int i;
 
-    if (T == NULL)
-        runtime_error("Element not found");
-    else if (X < T->Element)
-        T->Left = Delete(X, T->Left);
-    else if (X > T->Element)
-        T->Right = Delete(X, T->Right);
-    else if (T->Left && T->Right)
+    while (P != NULL)
     {
-        TmpCell = FindMin(T->Right);
-        T->Element = TmpCell->Element;
-        T->Right = Delete(T->Element, T->Right);
+        if (P->Left != NULL)
+        {
+            L = P->Left;
+            P->Left = L->Right;
+            L->Right = P;
+            P = L;
+        }
+        else
+        {
+            L = P->Right;
+            DeleteNode(P);
+            P = L;
+        }
     }
-    else
+    for (i = 0; i < 3; i++)
+        FreeLimbo(i, T);
+    for (R = atomic_load(&T->Readers); R != NULL; R = RN)
     {
-        TmpCell = T;
-        if (T->Left == NULL)
-            T = T->Right;
-        else if (T->Right == NULL)
-            T = T->Left;
-        DeleteNode(TmpCell);
+        RN = R->Next;
+        Free(R);
     }
-    return T;
+    pthread_mutex_destroy(&T->WriteLock);
+    Free(T);
 }
 
-ElementType Retrieve(Position P)
+ReaderHandle AttachReader(PersistentAvl T)
 {
-    return P->Element;
+    ReaderHandle R, Head;
+    int Expected;
+
+    for (R = atomic_load_explicit(&T->Readers, memory_order_acquire); R != NULL; R = R->Next)
+    {
+        Expected = 0;
+        if (atomic_compare_exchange_strong(&R->InUse, &Expected, 1))
+            return R;
+    }
+
+    R = (ReaderHandle)Malloc(sizeof(struct ReaderRecord));
+    atomic_init(&R->State, 0);
+    atomic_init(&R->InUse, 1);
+    R->Tree = T;
+    Head = atomic_load_explicit(&T->Readers, memory_order_relaxed);
+    do
+        R->Next = Head;
+    while (!atomic_compare_exchange_weak_explicit(&T->Readers, &Head, R,
+                                                  memory_order_release, memory_order_relaxed));
+    return R;
 }
 
-Position FindPrev(ElementType X, SearchTree T)
+void DetachReader(ReaderHandle R)
 {
-    if (T == NULL)
-        runtime_error("Empty Tree");
-    Position P = NULL, N;
-    if (T->Element == X)
-        N = T->Left;
-    else if (T->Element < X)
-        N = T->Right;
-    else
-        N = T->Left;
-    if (N != NULL)
+    atomic_store(&R->State, 0);
+    atomic_store(&R->InUse, 0);
+}
+
+// the returned snapshot stays valid and unchanged until ReadUnlock
+AvlTree ReadLock(ReaderHandle R)
+{
+    atomic_store(&R->State, (atomic_load(&R->Tree->GlobalEpoch) << 1) | 1);
+    return atomic_load(&R->Tree->Root);
+}
+
+void ReadUnlock(ReaderHandle R)
+{
+    atomic_store_explicit(&R->State, 0, memory_order_release);
+}
+
+Position Find(ElementType X, AvlTree Root)
+{
+    while (Root != NULL && X != Root->Element)
     {
-        P = FindPrev(X, N);
+        if (X < Root->Element)
+            Root = Root->Left;
+        else
+            Root = Root->Right;
     }
-    if (T->Element < X)
+    return Root;
+}
+
+Position FindMin(AvlTree Root)
+{
+    if (Root != NULL)
+        while (Root->Left != NULL)
+            Root = Root->Left;
+    return Root;
+}
+
+Position FindMax(AvlTree Root)
+{
+    if (Root != NULL)
+        while (Root->Right != NULL)
+            Root = Root->Right;
+    return Root;
+}
+
+ElementType Retrieve(Position P)
+{
+    return P->Element;
+}
+
+// publishes the new root, then files the replaced nodes under the epoch
+// current after publication; they are freed two epochs later
+static void Publish(AvlTree Root, PersistentAvl T)
+{
+    unsigned int Epoch;
+    Position P;
+    int i;
+
+    atomic_store(&T->Root, Root);
+    TryAdvance(T);
+    Epoch = atomic_load(&T->GlobalEpoch);
+    for (i = 0; i < 3; i++)
+        if (T->Limbo[i] != NULL && T->LimboEpoch[i] + 2 <= Epoch)
+            FreeLimbo(i, T);
+    if (T->Pending != NULL)
     {
-        if (P == NULL || P->Element < T->Element)
-            P = T;
+        i = Epoch % 3;
+        for (P = T->Pending; P->Retired != NULL; P = P->Retired)
+            ;
+        P->Retired = T->Limbo[i];
+        T->Limbo[i] = T->Pending;
+        T->LimboEpoch[i] = Epoch;
+        T->Pending = NULL;
     }
-    return P;
 }
 
-Position FindNext(ElementType X, SearchTree T)
+// both return the root of the version they published. Its nodes are only
+// retired by a later update, so it stays readable until the next Insert or
+// Delete on T, or for as long as the caller holds a ReadLock
+AvlTree Insert(ElementType X, PersistentAvl T)
 {
-    if (T == NULL)
-        runtime_error("Empty Tree");
-    Position P = NULL, N;
-    if (T->Element == X)
-        N = T->Right;
-    else if (T->Element < X)
-        N = T->Right;
-    else
-        N = T->Left;
-    if (N != NULL)
+    AvlTree Root;
+
+    pthread_mutex_lock(&T->WriteLock);
+    Root = atomic_load_explicit(&T->Root, memory_order_relaxed);
+    if (Find(X, Root) == NULL)
     {
-        P = FindNext(X, N);
+        T->Version++;
+        Root = InsertCopy(X, Root, T);
+        Publish(Root, T);
     }
-    if (T->Element > X)
+    pthread_mutex_unlock(&T->WriteLock);
+    return Root;
+}
+
+AvlTree Delete(ElementType X, PersistentAvl T)
+{
+    AvlTree Root;
+
+    pthread_mutex_lock(&T->WriteLock);
+    Root = atomic_load_explicit(&T->Root, memory_order_relaxed);
+    if (Find(X, Root) == NULL)
     {
-        if (P == NULL || P->Element > T->Element)
-            P = T;
+        pthread_mutex_unlock(&T->WriteLock);
+        runtime_error("Element not found");
     }
-    return P;
+    T->Version++;
+    Root = DeleteCopy(X, Root, T);
+    Publish(Root, T);
+    pthread_mutex_unlock(&T->WriteLock);
+    return Root;
 }
 
 #endif
 
-#ifdef _Tree_H_NR
+#ifdef _RBTree_H
 
-static SearchTree NewNode(ElementType X, SearchTree Left, SearchTree Right)
+static RBTree NewNode(ElementType X, Position Parent)
 {
-    SearchTree T = (SearchTree)Malloc(sizeof(struct TreeNode));
+    RBTree T = (RBTree)Malloc(sizeof(struct RBNode));
     T->Element = X;
-    T->Left = Left;
-    T->Right = Right;
+    T->Left = T->Right = NULL;
+    T->Parent = Parent;
+    T->Color = RBRed;
     return T;
 }
 
-static void DeleteNode(SearchTree T)
+static void DeleteNode(Position P)
 {
-    Free(T);
+    Free(P);
 }
 
-static void ModifyLine(Position P, LinkLine L)
+// empty leaves count as black
+static int IsBlack(Position P)
 {
-    if (L != NULL)
-        *L = P;
+    return P == NULL || P->Color == RBBlack;
 }
 
-SearchTree MakeEmpty(SearchTree T)
+static RBTree RotateLeft(Position X, RBTree T)
 {
-    if (T != NULL)
+    Position Y = X->Right;
+
+    X->Right = Y->Left;
+    if (Y->Left != NULL)
+        Y->Left->Parent = X;
+    Y->Parent = X->Parent;
+    if (X->Parent == NULL)
+        T = Y;
+    else if (X == X->Parent->Left)
+        X->Parent->Left = Y;
+    else
+        X->Parent->Right = Y;
+    Y->Left = X;
+    X->Parent = Y;
+    return T;
+}
+
+static RBTree RotateRight(Position X, RBTree T)
+{
+    Position Y = X->Left;
+
+    X->Left = Y->Right;
+    if (Y->Right != NULL)
+        Y->Right->Parent = X;
+    Y->Parent = X->Parent;
+    if (X->Parent == NULL)
+        T = Y;
+    else if (X == X->Parent->Right)
+        X->Parent->Right = Y;
+    else
+        X->Parent->Left = Y;
+    Y->Right = X;
+    X->Parent = Y;
+    return T;
+}
+
+// Z is red; at most two rotations, recolouring may climb to the root
+static RBTree InsertFixup(Position Z, RBTree T)
+{
+    Position P, G, U;
+
+    while ((P = Z->Parent) != NULL && P->Color == RBRed)
     {
-        MakeEmpty(T->Left);
-        MakeEmpty(T->Right);
-        DeleteNode(T);
+        G = P->Parent;
+        if (P == G->Left)
+        {
+            U = G->Right;
+            if (!IsBlack(U))
+            {
+                P->Color = U->Color = RBBlack;
+                G->Color = RBRed;
+                Z = G;
+                continue;
+            }
+            if (Z == P->Right)
+            {
+                T = RotateLeft(P, T);
+                Z = P;
+                P = Z->Parent;
+            }
+            P->Color = RBBlack;
+            G->Color = RBRed;
+            T = RotateRight(G, T);
+        }
+        else
+        {
+            U = G->Left;
+            if (!IsBlack(U))
+            {
+                P->Color = U->Color = RBBlack;
+                G->Color = RBRed;
+                Z = G;
+                continue;
+            }
+            if (Z == P->Left)
+            {
+                T = RotateRight(P, T);
+                Z = P;
+                P = Z->Parent;
+            }
+            P->Color = RBBlack;
+            G->Color = RBRed;
+            T = RotateLeft(G, T);
+        }
+    }
+    T->Color = RBBlack;
+    return T;
+}
+
+// X carries an extra black and may be NULL, so its parent is passed too
+static RBTree DeleteFixup(Position X, Position Parent, RBTree T)
+{
+    Position W;
+
+    while (X != T && IsBlack(X))
+    {
+        if (X == Parent->Left)
+        {
+            W = Parent->Right;
+            if (W->Color == RBRed)
+            {
+                W->Color = RBBlack;
+                Parent->Color = RBRed;
+                T = RotateLeft(Parent, T);
+                W = Parent->Right;
+            }
+            if (IsBlack(W->Left) && IsBlack(W->Right))
+            {
+                W->Color = RBRed;
+                X = Parent;
+                Parent = X->Parent;
+                continue;
+            }
+            if (IsBlack(W->Right))
+            {
+                W->Left->Color = RBBlack;
+                W->Color = RBRed;
+                T = RotateRight(W, T);
+                W = Parent->Right;
+            }
+            W->Color = Parent->Color;
+            Parent->Color = RBBlack;
+            W->Right->Color = RBBlack;
+            T = RotateLeft(Parent, T);
+        }
+        else
+        {
+            W = Parent->Left;
+            if (W->Color == RBRed)
+            {
+                W->Color = RBBlack;
+                Parent->Color = RBRed;
+                T = RotateRight(Parent, T);
+                W = Parent->Left;
+            }
+            if (IsBlack(W->Left) && IsBlack(W->Right))
+            {
+                W->Color = RBRed;
+                X = Parent;
+                Parent = X->Parent;
+                continue;
+            }
+            if (IsBlack(W->Left))
+            {
+                W->Right->Color = RBBlack;
+                W->Color = RBRed;
+                T = RotateLeft(W, T);
+                W = Parent->Left;
+            }
+            W->Color = Parent->Color;
+            Parent->Color = RBBlack;
+            W->Left->Color = RBBlack;
+            T = RotateRight(Parent, T);
+        }
+        X = T;
+    }
+    if (X != NULL)
+        X->Color = RBBlack;
+    return T;
+}
+
+// rotates left children up so every node is freed with an empty left subtree
+RBTree MakeEmpty(RBTree T)
+{
+    Position L, R;
+    while (T != NULL)
+    {
+        if (T->Left != NULL)
+        {
+            L = T->Left;
+            T->Left = L->Right;
+            L->Right = T;
+            T = L;
+        }
+        else
+        {
+            R = T->Right;
+            DeleteNode(T);
+            T = R;
+        }
     }
     return NULL;
 }
 
-Position Find(ElementType X, SearchTree T)
+Position Find(ElementType X, RBTree T)
 {
-    while (T != NULL)
+    while (T != NULL && !ElementEqual(X, T->Element))
     {
-        if (T->Element > X)
+        if (ElementLess(X, T->Element))
             T = T->Left;
-        else if (T->Element < X)
-            T = T->Right;
         else
-            break;
+            T = T->Right;
     }
     return T;
 }
 
-Position FindMin(SearchTree T)
+Position FindMin(RBTree T)
 {
     if (T != NULL)
         while (T->Left != NULL)
@@ -1076,7 +5592,7 @@ Position FindMin(SearchTree T)
     return T;
 }
 
-Position FindMax(SearchTree T)
+Position FindMax(RBTree T)
 {
     if (T != NULL)
         while (T->Right != NULL)
@@ -1084,79 +5600,58 @@ Position FindMax(SearchTree T)
     return T;
 }
 
-void Insert(ElementType X, LinkLine LT)
+RBTree Insert(ElementType X, RBTree T)
 {
-    LinkLine L = LT;
-    SearchTree T = *LT;
-    while (T != NULL)
+    Position P = T, Y = NULL, Z;
+
+    while (P != NULL)
     {
-        if (T->Element > X)
-        {
-            L = &(T->Left);
-            T = T->Left;
-        }
-        else if (T->Element < X)
-        {
-            L = &(T->Right);
-            T = T->Right;
-        }
+        Y = P;
+        if (ElementLess(X, P->Element))
+            P = P->Left;
+        else if (ElementLess(P->Element, X))
+            P = P->Right;
         else
-            break;
-    }
-    if (T == NULL)
-    {
-        T = NewNode(X, NULL, NULL);
-        ModifyLine(T, L);
+            return T;
     }
-}
-
-static void DeleteSpecialTree(SearchTree T, LinkLine L)
-{
-    if (T->Left != NULL)
-        ModifyLine(T->Left, L);
+    Z = NewNode(X, Y);
+    if (Y == NULL)
+        T = Z;
+    else if (ElementLess(X, Y->Element))
+        Y->Left = Z;
     else
-        ModifyLine(T->Right, L);
-    DeleteNode(T);
+        Y->Right = Z;
+    return InsertFixup(Z, T);
 }
 
-void Delete(ElementType X, LinkLine LT)
+RBTree Delete(ElementType X, RBTree T)
 {
-    SearchTree T = *LT;
-    LinkLine L = LT;
-    while (T != NULL)
-    {
-        if (T->Element < X)
-        {
-            L = &(T->Right);
-            T = T->Right;
-        }
-        else if (T->Element > X)
-        {
-            L = &(T->Left);
-            T = T->Left;
-        }
-        else
-            break;
-    }
-    if (T == NULL)
+    Position Z, Y, C;
+
+    Z = Find(X, T);
+    if (Z == NULL)
         runtime_error("Element not found");
-    else
+    if (Z->Left != NULL && Z->Right != NULL)
     {
-        if (T->Left && T->Right)
-        {
-            SearchTree TP = T->Right;
-            LinkLine LP = &(T->Right);
-            while (TP->Left != NULL)
-            {
-                LP = &(TP->Left);
-                TP = TP->Left;
-            }
-            T->Element = TP->Element;
-            DeleteSpecialTree(TP, LP);
-        }
-        else
-            DeleteSpecialTree(T, L);
+        Y = FindMin(Z->Right);
+        Z->Element = Y->Element;
+        Z = Y;
     }
+
+    C = Z->Left != NULL ? Z->Left : Z->Right;
+    Y = Z->Parent;
+    if (C != NULL)
+        C->Parent = Y;
+    if (Y == NULL)
+        T = C;
+    else if (Z == Y->Left)
+        Y->Left = C;
+    else
+        Y->Right = C;
+    if (Z->Color == RBBlack)
+        T = DeleteFixup(C, Y, T);
+    DeleteNode(Z);
+    return T;
 }
 
 ElementType Retrieve(Position P)
@@ -1164,40 +5659,34 @@ ElementType Retrieve(Position P)
     return P->Element;
 }
 
-Position FindPrev(ElementType X, SearchTree T)
+Position FindPrev(ElementType X, RBTree T)
 {
+    Position P = NULL;
     if (T == NULL)
         runtime_error("Empty Tree");
-    Position P = NULL, N;
     while (T != NULL)
     {
-        if (T->Element < X)
+        if (ElementLess(T->Element, X))
         {
-            if (P == NULL || P->Element < T->Element)
-                P = T;
+            P = T;
             T = T->Right;
         }
-        else if (T->Element > X)
-            T = T->Left;
         else
             T = T->Left;
     }
     return P;
 }
 
-Position FindNext(ElementType X, SearchTree T)
+Position FindNext(ElementType X, RBTree T)
 {
+    Position P = NULL;
     if (T == NULL)
         runtime_error("Empty Tree");
-    Position P = NULL, N;
     while (T != NULL)
     {
-        if (T->Element < X)
-            T = T->Right;
-        else if (T->Element > X)
+        if (ElementLess(X, T->Element))
         {
-            if (P == NULL || P->Element > T->Element)
-                P = T;
+            P = T;
             T = T->Left;
         }
         else
@@ -1208,29 +5697,59 @@ Position FindNext(ElementType X, SearchTree T)
 
 #endif
 
-#ifdef _AvlTree_H
+#ifdef _Treap_H
 
-static AvlTree NewNode(ElementType X, AvlTree Left, AvlTree Right, int Height)
+static Position NewNode(ElementType X, Treap T)
 {
-    AvlTree T = (AvlTree)Malloc(sizeof(struct AvlNode));
-    T->Element = X;
-    T->Left = Left;
-    T->Right = Right;
-    T->Height = Height;
+    Position P = (Position)Malloc(sizeof(struct TreapNode));
+    P->Element = X;
+    P->Left = P->Right = NULL;
+    P->Priority = RandomPriority(T);
+    return P;
+}
+
+static void DeleteNode(Position P)
+{
+    Free(P);
+}
+
+// the _Random_H generator, kept to integers
+static long RandomPriority(Treap T)
+{
+    long TmpSeed;
+
+    TmpSeed = RandomA * (T->Seed % RandomQ) - RandomR * (T->Seed / RandomQ);
+    if (TmpSeed >= 0)
+        T->Seed = TmpSeed;
+    else
+        T->Seed = TmpSeed + RandomM;
+    return T->Seed;
+}
+
+Treap Initialize(void)
+{
+    Treap T = (Treap)Malloc(sizeof(struct TreapRecord));
+    T->Root = NULL;
+    T->Seed = 1;
     return T;
 }
 
-static void DeleteNode(AvlTree T)
+void DisposeTree(Treap T)
 {
+    MakeEmpty(T);
     Free(T);
 }
 
-static int Max(int ValueA, int ValueB)
+void SetSeed(unsigned long InitVal, Treap T)
 {
-    if (ValueA > ValueB)
-        return ValueA;
-    else
-        return ValueB;
+    T->Seed = InitVal % RandomM;
+    if (T->Seed == 0)
+        T->Seed = 1;
+}
+
+int IsEmpty(Treap T)
+{
+    return T->Root == NULL;
 }
 
 static Position SingleRotateWithLeft(Position K2)
@@ -1240,9 +5759,6 @@ static Position SingleRotateWithLeft(Position K2)
     K1 = K2->Left;
     K2->Left = K1->Right;
     K1->Right = K2;
-
-    UpdateHeight(K2);
-    UpdateHeight(K1);
     return K1;
 }
 
@@ -1253,154 +5769,121 @@ static Position SingleRotateWithRight(Position K1)
     K2 = K1->Right;
     K1->Right = K2->Left;
     K2->Left = K1;
-
-    UpdateHeight(K1);
-    UpdateHeight(K2);
     return K2;
 }
 
-static Position DoubleRotateWithLeft(Position K3)
-{
-    K3->Left = SingleRotateWithRight(K3->Left);
-
-    return SingleRotateWithLeft(K3);
-}
-
-static Position DoubleRotateWithRight(Position K1)
-{
-    K1->Right = SingleRotateWithLeft(K1->Right);
-
-    return SingleRotateWithRight(K1);
-}
-
-static int GetHeight(Position P)
-{
-    if (P == NULL)
-        return -1;
-    else
-        return P->Height;
-}
-
-static void UpdateHeight(Position P)
-{
-    if (P != NULL)
-        P->Height = Max(GetHeight(P->Left), GetHeight(P->Right)) + 1;
-}
-
-static AvlTree TryRotate(AvlTree T)
+// rotates left children up so every node is freed with an empty left subtree
+Treap MakeEmpty(Treap T)
 {
-    if (GetHeight(T->Right) - GetHeight(T->Left) == 2)
-    {
-        if (GetHeight(T->Right->Right) >= GetHeight(T->Right->Left))
-            T = SingleRotateWithRight(T);
-        else
-            T = DoubleRotateWithRight(T);
-    }
-    else if (GetHeight(T->Left) - GetHeight(T->Right) == 2)
+    Position P = T->Root, L, R;
+    while (P != NULL)
     {
-        if (GetHeight(T->Left->Left) >= GetHeight(T->Left->Right))
-            T = SingleRotateWithLeft(T);
+        if (P->Left != NULL)
+        {
+            L = P->Left;
+            P->Left = L->Right;
+            L->Right = P;
+            P = L;
+        }
         else
-            T = DoubleRotateWithLeft(T);
+        {
+            R = P->Right;
+            DeleteNode(P);
+            P = R;
+        }
     }
+    T->Root = NULL;
     return T;
 }
 
-AvlTree MakeEmpty(AvlTree T)
+Position Find(ElementType X, Treap T)
 {
-    if (T != NULL)
+    Position P = T->Root;
+    while (P != NULL && !ElementEqual(X, P->Element))
     {
-        MakeEmpty(T->Left);
-        MakeEmpty(T->Right);
-        DeleteNode(T);
+        if (ElementLess(X, P->Element))
+            P = P->Left;
+        else
+            P = P->Right;
     }
-    return NULL;
-}
-
-Position Find(ElementType X, AvlTree T)
-{
-    if (T == NULL)
-        return NULL;
-    if (X < T->Element)
-        return Find(X, T->Left);
-    else if (X > T->Element)
-        return Find(X, T->Right);
-    else
-        return T;
+    return P;
 }
 
-Position FindMin(AvlTree T)
+Position FindMin(Treap T)
 {
-    if (T == NULL)
-        return NULL;
-    else if (T->Left == NULL)
-        return T;
-    else
-        return FindMin(T->Left);
+    Position P = T->Root;
+    if (P != NULL)
+        while (P->Left != NULL)
+            P = P->Left;
+    return P;
 }
 
-Position FindMax(AvlTree T)
+Position FindMax(Treap T)
 {
-    if (T == NULL)
-        return NULL;
-    else if (T->Right == NULL)
-        return T;
-    else
-        return FindMax(T->Right);
+    Position P = T->Root;
+    if (P != NULL)
+        while (P->Right != NULL)
+            P = P->Right;
+    return P;
 }
 
-AvlTree Insert(ElementType X, AvlTree T)
+static Position InsertNode(ElementType X, Position P, Treap T)
 {
-    if (T == NULL)
-    {
-        T = NewNode(X, NULL, NULL, 0);
-    }
-    else if (X < T->Element)
+    if (P == NULL)
+        P = NewNode(X, T);
+    else if (ElementLess(X, P->Element))
     {
-        T->Left = Insert(X, T->Left);
-        T = TryRotate(T);
+        P->Left = InsertNode(X, P->Left, T);
+        if (P->Left->Priority < P->Priority)
+            P = SingleRotateWithLeft(P);
     }
-    else if (X > T->Element)
+    else if (ElementLess(P->Element, X))
     {
-        T->Right = Insert(X, T->Right);
-        T = TryRotate(T);
+        P->Right = InsertNode(X, P->Right, T);
+        if (P->Right->Priority < P->Priority)
+            P = SingleRotateWithRight(P);
     }
-    UpdateHeight(T);
+    return P;
+}
+
+Treap Insert(ElementType X, Treap T)
+{
+    T->Root = InsertNode(X, T->Root, T);
     return T;
 }
 
-AvlTree Delete(ElementType X, AvlTree T)
+// rotates the node down below its higher-priority child until it is a leaf
+Treap Delete(ElementType X, Treap T)
 {
-    Position TmpCell;
-    if (T == NULL)
-        runtime_error("Element not found");
-    else if (X < T->Element)
-    {
-        T->Left = Delete(X, T->Left);
-        T = TryRotate(T);
-    }
-    else if (X > T->Element)
-    {
-        T->Right = Delete(X, T->Right);
-        T = TryRotate(T);
-    }
-    else if (T->Left && T->Right)
-    {
-        TmpCell = FindMin(T->Right);
-        T->Element = TmpCell->Element;
-        T->Right = Delete(T->Element, T->Right);
-        T = TryRotate(T);
+    Position *Link = &T->Root;
+    Position P;
+
+    while (*Link != NULL && !ElementEqual(X, (*Link)->Element))
+    {
+        if (ElementLess(X, (*Link)->Element))
+            Link = &(*Link)->Left;
+        else
+            Link = &(*Link)->Right;
     }
-    else
+    if (*Link == NULL)
+        runtime_error("Element not found");
+
+    P = *Link;
+    while (P->Left != NULL && P->Right != NULL)
     {
-        TmpCell = T;
-        if (T->Left == NULL)
-            T = T->Right;
-        else if (T->Right == NULL)
-            T = T->Left;
-        DeleteNode(TmpCell);
+        if (P->Left->Priority < P->Right->Priority)
+        {
+            *Link = SingleRotateWithLeft(P);
+            Link = &(*Link)->Right;
+        }
+        else
+        {
+            *Link = SingleRotateWithRight(P);
+            Link = &(*Link)->Left;
+        }
     }
-    UpdateHeight(T);
+    *Link = P->Left != NULL ? P->Left : P->Right;
+    DeleteNode(P);
     return T;
 }
 
@@ -1409,48 +5892,38 @@ ElementType Retrieve(Position P)
     return P->Element;
 }
 
-Position FindPrev(ElementType X, AvlTree T)
+Position FindPrev(ElementType X, Treap T)
 {
-    if (T == NULL)
+    Position P = NULL, Q = T->Root;
+    if (Q == NULL)
         runtime_error("Empty Tree");
-    Position P = NULL, N;
-    if (T->Element == X)
-        N = T->Left;
-    else if (T->Element < X)
-        N = T->Right;
-    else
-        N = T->Left;
-    if (N != NULL)
-    {
-        P = FindPrev(X, N);
-    }
-    if (T->Element < X)
+    while (Q != NULL)
     {
-        if (P == NULL || P->Element < T->Element)
-            P = T;
+        if (ElementLess(Q->Element, X))
+        {
+            P = Q;
+            Q = Q->Right;
+        }
+        else
+            Q = Q->Left;
     }
     return P;
 }
 
-Position FindNext(ElementType X, AvlTree T)
+Position FindNext(ElementType X, Treap T)
 {
-    if (T == NULL)
+    Position P = NULL, Q = T->Root;
+    if (Q == NULL)
         runtime_error("Empty Tree");
-    Position P = NULL, N;
-    if (T->Element == X)
-        N = T->Right;
-    else if (T->Element < X)
-        N = T->Right;
-    else
-        N = T->Left;
-    if (N != NULL)
-    {
-        P = FindNext(X, N);
-    }
-    if (T->Element > X)
+    while (Q != NULL)
     {
-        if (P == NULL || P->Element > T->Element)
-            P = T;
+        if (ElementLess(X, Q->Element))
+        {
+            P = Q;
+            Q = Q->Left;
+        }
+        else
+            Q = Q->Right;
     }
     return P;
 }
@@ -1459,6 +5932,12 @@ Position FindNext(ElementType X, AvlTree T)
 
 #ifdef _HashSep_H
 
+#ifdef ElementHash
+Index Hash(ElementType KeyValue, int TableSize)
+{
+    return ElementHash(KeyValue) % TableSize;
+}
+#else
 char *ConvertToString(ElementType KeyValue)
 {
     char *s = (char *)Malloc(20);
@@ -1476,12 +5955,16 @@ Index Hash(ElementType KeyValue, int TableSize)
     Free(P);
     return HashVal;
 }
+#endif
 
 Position NewNode(ElementType X, Position PNext)
 {
     Position P;
     P = (Position)Malloc(sizeof(struct ListNode));
     P->Element = X;
+#ifdef ValueType
+    memset(&P->Value, 0, sizeof(ValueType));
+#endif
     P->Next = PNext;
     return P;
 }
@@ -1523,7 +6006,6 @@ HashTable InitializeTable(int TableSize)
     H->TableSize = NextPrime(TableSize);
     H->TheLists = (List *)Malloc(sizeof(List) * H->TableSize);
 
-    int i;
     for (i = 0; i < H->TableSize; i++)
         H->TheLists[i] = NULL;
     return H;
@@ -1533,7 +6015,7 @@ Position Find(ElementType Key, HashTable H)
 {
     Position P;
     P = H->TheLists[Hash(Key, H->TableSize)];
-    while (P != NULL && P->Element != Key)
+    while (P != NULL && !ElementEqual(P->Element, Key))
         P = P->Next;
     return P;
 }
@@ -1579,10 +6061,45 @@ ElementType Retrieve(Position P)
     return P->Element;
 }
 
+#ifdef ValueType
+// the pointer stays valid until Key's node is destroyed
+ValueType *FindValue(ElementType Key, HashTable H)
+{
+    Position P = Find(Key, H);
+    return P == NULL ? NULL : &P->Value;
+}
+
+ValueType *InsertOrAssign(ElementType Key, ValueType Value, HashTable H)
+{
+    ValueType *V = Upsert(Key, H);
+    *V = Value;
+    return V;
+}
+
+// hashes once: the existing value slot, or a zeroed one for a new key
+ValueType *Upsert(ElementType Key, HashTable H)
+{
+    List *L = &H->TheLists[Hash(Key, H->TableSize)];
+    Position P = *L;
+
+    while (P != NULL && !ElementEqual(P->Element, Key))
+        P = P->Next;
+    if (P == NULL)
+        P = *L = NewNode(Key, *L);
+    return &P->Value;
+}
+#endif
+
 #endif
 
 #ifdef _HashQuad_H
 
+#ifdef ElementHash
+Index Hash(ElementType KeyValue, int TableSize)
+{
+    return ElementHash(KeyValue) % TableSize;
+}
+#else
 char *ConvertToString(ElementType KeyValue)
 {
     char *s = (char *)Malloc(20);
@@ -1600,6 +6117,7 @@ Index Hash(ElementType KeyValue, int TableSize)
     Free(P);
     return HashVal;
 }
+#endif
 
 static int IsPrime(int Value)
 {
@@ -1655,7 +6173,7 @@ Position Find(ElementType Key, HashTable H)
 
     CollisionNum = 0;
     CurrentPos = Hash(Key, H->TableSize);
-    while (H->TheCells[CurrentPos].Info != Empty && H->TheCells[CurrentPos].Element != Key)
+    while (H->TheCells[CurrentPos].Info != Empty && !ElementEqual(H->TheCells[CurrentPos].Element, Key))
     {
         CurrentPos += 2 * ++CollisionNum - 1;
         CurrentPos = CurrentPos % H->TableSize;
@@ -1663,109 +6181,355 @@ Position Find(ElementType Key, HashTable H)
     return CurrentPos;
 }
 
-void Insert(ElementType Key, HashTable H)
+void Insert(ElementType Key, HashTable H)
+{
+    Position Pos;
+    Pos = Find(Key, H);
+    if (H->TheCells[Pos].Info != Legitimate)
+    {
+        H->TheCells[Pos].Info = Legitimate;
+        H->TheCells[Pos].Element = Key;
+#ifdef ValueType
+        memset(&H->TheCells[Pos].Value, 0, sizeof(ValueType));
+#endif
+    }
+}
+
+ElementType Retrieve(Position P, HashTable H)
+{
+    return H->TheCells[P].Element;
+}
+
+HashTable Rehash(HashTable H)
+{
+    int i, OldSize;
+    Cell *OldCells;
+    HashTable OldH;
+
+    OldH = H;
+    OldCells = H->TheCells;
+    OldSize = H->TableSize;
+
+    H = InitializeTable(2 * OldSize);
+
+    for (int i = 0; i < OldSize; i++)
+        if (OldCells[i].Info == Legitimate)
+#ifdef ValueType
+            InsertOrAssign(OldCells[i].Element, OldCells[i].Value, H);
+#else
+            Insert(OldCells[i].Element, H);
+#endif
+
+    DestroyTable(OldH);
+    return H;
+}
+
+#ifdef ValueType
+// the pointer stays valid until the table is rehashed
+ValueType *FindValue(ElementType Key, HashTable H)
+{
+    Position Pos = Find(Key, H);
+    return H->TheCells[Pos].Info == Legitimate ? &H->TheCells[Pos].Value : NULL;
+}
+
+ValueType *InsertOrAssign(ElementType Key, ValueType Value, HashTable H)
+{
+    ValueType *V = Upsert(Key, H);
+    *V = Value;
+    return V;
+}
+
+// probes once: the existing value slot, or a zeroed one for a new key
+ValueType *Upsert(ElementType Key, HashTable H)
+{
+    Position Pos = Find(Key, H);
+    if (H->TheCells[Pos].Info != Legitimate)
+    {
+        H->TheCells[Pos].Info = Legitimate;
+        H->TheCells[Pos].Element = Key;
+        memset(&H->TheCells[Pos].Value, 0, sizeof(ValueType));
+    }
+    return &H->TheCells[Pos].Value;
+}
+#endif
+
+#endif
+
+#ifdef _BinHeap_H
+
+PriorityQueue Initialize(int MaxElements)
+{
+    PriorityQueue H;
+
+    if (MaxElements < MinPQSize)
+        runtime_error("Priority queue size is too small");
+
+    H = (PriorityQueue)Malloc(sizeof(struct HeapStruct));
+
+    H->Elements = (ElementType *)Malloc(sizeof(ElementType) * MaxElements);
+    H->Capacity = MaxElements;
+    H->Size = 0;
+    H->Elements[0] = MinData;
+
+    return H;
+}
+
+void Destroy(PriorityQueue H)
+{
+    Free(H->Elements);
+    Free(H);
+}
+
+void MakeEmpty(PriorityQueue H)
+{
+    H->Size = 0;
+}
+
+void Insert(ElementType X, PriorityQueue H)
+{
+    int i;
+
+    if (IsFull(H))
+        runtime_error("Priority queue is full");
+
+    for (i = ++H->Size; ElementLess(X, H->Elements[i / 2]); i /= 2)
+        H->Elements[i] = H->Elements[i / 2];
+    H->Elements[i] = X;
+}
+
+ElementType DeleteMin(PriorityQueue H)
+{
+    int i, Child;
+    ElementType MinElement, LastElement;
+
+    if (IsEmpty(H))
+        runtime_error("Priority queue is empty");
+
+    MinElement = H->Elements[1];
+    LastElement = H->Elements[H->Size--];
+
+    for (i = 1; i * 2 <= H->Size; i = Child)
+    {
+        Child = i * 2;
+        if (Child != H->Size && ElementLess(H->Elements[Child + 1], H->Elements[Child]))
+            Child++;
+
+        if (ElementLess(H->Elements[Child], LastElement))
+            H->Elements[i] = H->Elements[Child];
+        else
+            break;
+    }
+    H->Elements[i] = LastElement;
+    return MinElement;
+}
+
+ElementType FindMin(PriorityQueue H)
+{
+    if (IsEmpty(H))
+        runtime_error("Priority queue is empty");
+    return H->Elements[1];
+}
+
+int IsEmpty(PriorityQueue H)
+{
+    return H->Size == 0;
+}
+
+int IsFull(PriorityQueue H)
+{
+    return H->Size == H->Capacity;
+}
+
+#endif
+
+#ifdef _RadixHeap_H
+
+static void PushBucket(ElementType X, struct RadixBucket *B)
+{
+    if (B->Size == B->Capacity)
+    {
+        B->Capacity = B->Capacity ? 2 * B->Capacity : MinBucketSize;
+        B->Elements = (ElementType *)Realloc(B->Elements, sizeof(ElementType) * B->Capacity);
+    }
+    B->Elements[B->Size++] = X;
+}
+
+static int BucketIndex(ElementType X, ElementType Last)
+{
+    unsigned long long Diff = (unsigned long long)X ^ (unsigned long long)Last;
+    int i = 0;
+
+    if (Diff == 0)
+        return 0;
+#ifdef __GNUC__
+    i = 64 - __builtin_clzll(Diff);
+#else
+    while (Diff != 0)
+    {
+        Diff >>= 1;
+        i++;
+    }
+#endif
+    return i;
+}
+
+static void Refill(PriorityQueue H)
+{
+    struct RadixBucket *B;
+    ElementType NewLast;
+    int i, j;
+
+    if (H->Buckets[0].Size != 0)
+        return;
+
+    for (i = 1; H->Buckets[i].Size == 0; i++)
+        ;
+    B = &H->Buckets[i];
+
+    NewLast = B->Elements[0];
+    for (j = 1; j < B->Size; j++)
+        if (B->Elements[j] < NewLast)
+            NewLast = B->Elements[j];
+
+    H->Last = NewLast;
+    for (j = 0; j < B->Size; j++)
+        PushBucket(B->Elements[j], &H->Buckets[BucketIndex(B->Elements[j], NewLast)]);
+    B->Size = 0;
+}
+
+PriorityQueue Initialize(void)
+{
+    PriorityQueue H;
+    int i;
+
+    H = (PriorityQueue)Malloc(sizeof(struct RadixHeapStruct));
+    for (i = 0; i < RadixBuckets; i++)
+    {
+        H->Buckets[i].Capacity = 0;
+        H->Buckets[i].Size = 0;
+        H->Buckets[i].Elements = NULL;
+    }
+    MakeEmpty(H);
+    return H;
+}
+
+void Destroy(PriorityQueue H)
+{
+    int i;
+    for (i = 0; i < RadixBuckets; i++)
+        Free(H->Buckets[i].Elements);
+    Free(H);
+}
+
+void MakeEmpty(PriorityQueue H)
 {
-    Position Pos;
-    Pos = Find(Key, H);
-    if (H->TheCells[Pos].Info != Legitimate)
-    {
-        H->TheCells[Pos].Info = Legitimate;
-        H->TheCells[Pos].Element = Key;
-    }
+    int i;
+    for (i = 0; i < RadixBuckets; i++)
+        H->Buckets[i].Size = 0;
+    H->Size = 0;
+    H->Last = 0;
 }
 
-ElementType Retrieve(Position P, HashTable H)
+void Insert(ElementType X, PriorityQueue H)
 {
-    return H->TheCells[P].Element;
+    if (X < H->Last)
+        runtime_error("Radix heap keys must not be smaller than the last minimum");
+    PushBucket(X, &H->Buckets[BucketIndex(X, H->Last)]);
+    H->Size++;
 }
 
-HashTable Rehash(HashTable H)
+ElementType DeleteMin(PriorityQueue H)
 {
-    int i, OldSize;
-    Cell *OldCells;
-    HashTable OldH;
+    if (IsEmpty(H))
+        runtime_error("Priority queue is empty");
 
-    OldH = H;
-    OldCells = H->TheCells;
-    OldSize = H->TableSize;
+    Refill(H);
+    H->Buckets[0].Size--;
+    H->Size--;
+    return H->Last;
+}
 
-    H = InitializeTable(2 * OldSize);
+ElementType FindMin(PriorityQueue H)
+{
+    if (IsEmpty(H))
+        runtime_error("Priority queue is empty");
 
-    for (int i = 0; i < OldSize; i++)
-        if (OldCells[i].Info == Legitimate)
-            Insert(OldCells[i].Element, H);
+    Refill(H);
+    return H->Last;
+}
 
-    DestroyTable(OldH);
-    return H;
+int IsEmpty(PriorityQueue H)
+{
+    return H->Size == 0;
 }
 
 #endif
 
-#ifdef _BinHeap_H
+#ifdef _BucketQueue_H
 
-PriorityQueue Initialize(int MaxElements)
+static void PushBucket(ElementType X, struct Bucket *B)
 {
-    PriorityQueue H;
-
-    if (MaxElements < MinPQSize)
-        runtime_error("Priority queue size is too small");
+    if (B->Size == B->Capacity)
+    {
+        B->Capacity = B->Capacity ? 2 * B->Capacity : MinBucketSize;
+        B->Elements = (ElementType *)Realloc(B->Elements, sizeof(ElementType) * B->Capacity);
+    }
+    B->Elements[B->Size++] = X;
+}
 
-    H = (PriorityQueue)Malloc(sizeof(struct HeapStruct));
+PriorityQueue Initialize(int MaxWeight)
+{
+    PriorityQueue H;
+    int i;
 
-    H->Elements = (ElementType *)Malloc(sizeof(ElementType) * MaxElements);
-    H->Capacity = MaxElements;
-    H->Size = 0;
-    H->Elements[0] = MinData;
+    if (MaxWeight < 1)
+        runtime_error("Max weight is too small");
 
+    H = (PriorityQueue)Malloc(sizeof(struct BucketQueueStruct));
+    H->NumBuckets = MaxWeight + 1;
+    H->Buckets = (struct Bucket *)Malloc(sizeof(struct Bucket) * H->NumBuckets);
+    for (i = 0; i < H->NumBuckets; i++)
+    {
+        H->Buckets[i].Capacity = 0;
+        H->Buckets[i].Size = 0;
+        H->Buckets[i].Elements = NULL;
+    }
+    MakeEmpty(H);
     return H;
 }
 
 void Destroy(PriorityQueue H)
 {
-    Free(H->Elements);
+    int i;
+    for (i = 0; i < H->NumBuckets; i++)
+        Free(H->Buckets[i].Elements);
+    Free(H->Buckets);
     Free(H);
 }
 
 void MakeEmpty(PriorityQueue H)
 {
+    int i;
+    for (i = 0; i < H->NumBuckets; i++)
+        H->Buckets[i].Size = 0;
     H->Size = 0;
+    H->Last = 0;
 }
 
 void Insert(ElementType X, PriorityQueue H)
 {
-    int i;
-
-    if (IsFull(H))
-        runtime_error("Priority queue is full");
-
-    for (i = ++H->Size; H->Elements[i / 2] > X; i /= 2)
-        H->Elements[i] = H->Elements[i / 2];
-    H->Elements[i] = X;
+    if (X < H->Last || X - H->Last >= (ElementType)H->NumBuckets)
+        runtime_error("Key is out of the bucket queue window");
+    PushBucket(X, &H->Buckets[X % H->NumBuckets]);
+    H->Size++;
 }
 
 ElementType DeleteMin(PriorityQueue H)
 {
-    int i, Child;
-    ElementType MinElement, LastElement;
-
-    if (IsEmpty(H))
-        runtime_error("Priority queue is empty");
-
-    MinElement = H->Elements[1];
-    LastElement = H->Elements[H->Size--];
-
-    for (i = 1; i * 2 <= H->Size; i = Child)
-    {
-        Child = i * 2;
-        if (Child != H->Size && H->Elements[Child + 1] < H->Elements[Child])
-            Child++;
+    ElementType MinElement = FindMin(H);
 
-        if (LastElement > H->Elements[Child])
-            H->Elements[i] = H->Elements[Child];
-        else
-            break;
-    }
-    H->Elements[i] = LastElement;
+    H->Buckets[MinElement % H->NumBuckets].Size--;
+    H->Size--;
     return MinElement;
 }
 
@@ -1773,7 +6537,10 @@ ElementType FindMin(PriorityQueue H)
 {
     if (IsEmpty(H))
         runtime_error("Priority queue is empty");
-    return H->Elements[1];
+
+    while (H->Buckets[H->Last % H->NumBuckets].Size == 0)
+        H->Last++;
+    return H->Last;
 }
 
 int IsEmpty(PriorityQueue H)
@@ -1781,15 +6548,21 @@ int IsEmpty(PriorityQueue H)
     return H->Size == 0;
 }
 
-int IsFull(PriorityQueue H)
-{
-    return H->Size == H->Capacity;
-}
-
 #endif
 
 #ifdef _LeftHeap_H
 
+#ifdef _SkewHeap
+static PriorityQueue NewNode(ElementType X, PriorityQueue Left, PriorityQueue Right)
+{
+    PriorityQueue H;
+    H = (PriorityQueue)Malloc(sizeof(struct TreeNode));
+    H->Element = X;
+    H->Left = Left;
+    H->Right = Right;
+    return H;
+}
+#else
 static PriorityQueue NewNode(ElementType X, PriorityQueue Left, PriorityQueue Right, int Npl)
 {
     PriorityQueue H;
@@ -1801,11 +6574,21 @@ static PriorityQueue NewNode(ElementType X, PriorityQueue Left, PriorityQueue Ri
     return H;
 }
 
+static int GetNpl(PriorityQueue H)
+{
+    if (H == NULL)
+        return -1;
+    else
+        return H->Npl;
+}
+#endif
+
 void DeleteNode(PriorityQueue H)
 {
     Free(H);
 }
 
+#ifndef _SkewHeap
 static void SwapChild(PriorityQueue H)
 {
     PriorityQueue TmpCell;
@@ -1813,12 +6596,37 @@ static void SwapChild(PriorityQueue H)
     H->Left = H->Right;
     H->Right = TmpCell;
 }
+#endif
 
 PriorityQueue Initialize(void)
 {
     return NULL;
 }
 
+PriorityQueue MakeEmpty(PriorityQueue H)
+{
+    PriorityQueue TmpCell;
+
+    // rotate left children up so the whole heap is freed along right links
+    while (H != NULL)
+    {
+        if (H->Left != NULL)
+        {
+            TmpCell = H->Left;
+            H->Left = TmpCell->Right;
+            TmpCell->Right = H;
+            H = TmpCell;
+        }
+        else
+        {
+            TmpCell = H->Right;
+            DeleteNode(H);
+            H = TmpCell;
+        }
+    }
+    return NULL;
+}
+
 ElementType FindMin(PriorityQueue H)
 {
     return H->Element;
@@ -1829,37 +6637,103 @@ int IsEmpty(PriorityQueue H)
     return H == NULL;
 }
 
+#ifdef _SkewHeap
 PriorityQueue Merge(PriorityQueue H1, PriorityQueue H2)
 {
-    if (H1 == NULL)
-        return H2;
-    if (H2 == NULL)
-        return H1;
-    if (H1->Element < H2->Element)
-        return Merge1(H1, H2);
-    else
-        return Merge1(H2, H1);
+    PriorityQueue Root, TmpCell, *Link;
+
+    Link = &Root;
+    while (H1 != NULL && H2 != NULL)
+    {
+        if (H2->Element < H1->Element)
+        {
+            TmpCell = H1;
+            H1 = H2;
+            H2 = TmpCell;
+        }
+        *Link = H1;
+        TmpCell = H1->Right;
+        H1->Right = H1->Left;
+        Link = &H1->Left;
+        H1 = TmpCell;
+    }
+    *Link = (H1 != NULL) ? H1 : H2;
+    return Root;
+}
+#else
+PriorityQueue Merge(PriorityQueue H1, PriorityQueue H2)
+{
+    PriorityQueue Path[MaxRightPath];
+    PriorityQueue Root, TmpCell, *Link;
+    int Top = 0;
+
+    // first pass: merge the two right paths, remembering the merged path
+    Link = &Root;
+    while (H1 != NULL && H2 != NULL)
+    {
+        if (H2->Element < H1->Element)
+        {
+            TmpCell = H1;
+            H1 = H2;
+            H2 = TmpCell;
+        }
+        *Link = H1;
+        Path[Top++] = H1;
+        Link = &H1->Right;
+        H1 = H1->Right;
+    }
+    *Link = (H1 != NULL) ? H1 : H2;
+
+    // second pass: restore the leftist property bottom-up
+    while (Top > 0)
+    {
+        TmpCell = Path[--Top];
+        if (GetNpl(TmpCell->Left) < GetNpl(TmpCell->Right))
+            SwapChild(TmpCell);
+        TmpCell->Npl = GetNpl(TmpCell->Right) + 1;
+    }
+    return Root;
 }
+#endif
 
-static PriorityQueue Merge1(PriorityQueue H1, PriorityQueue H2)
+PriorityQueue BuildHeap(ElementType A[], int N)
 {
-    if (H1->Left == NULL)
-        H1->Left = H2;
-    else
+    PriorityQueue H, *Queue;
+    int i, Width;
+
+    if (N <= 0)
+        return NULL;
+
+    Queue = (PriorityQueue *)Malloc(sizeof(PriorityQueue) * N);
+    for (i = 0; i < N; i++)
+#ifdef _SkewHeap
+        Queue[i] = NewNode(A[i], NULL, NULL);
+#else
+        Queue[i] = NewNode(A[i], NULL, NULL, 0);
+#endif
+
+    for (Width = N; Width > 1; Width = (Width + 1) / 2)
     {
-        H1->Right = Merge(H1->Right, H2);
-        if (H1->Left->Npl < H1->Right->Npl)
-            SwapChild(H1);
-        H1->Npl = H1->Right->Npl + 1;
+        for (i = 0; 2 * i + 1 < Width; i++)
+            Queue[i] = Merge(Queue[2 * i], Queue[2 * i + 1]);
+        if (Width % 2)
+            Queue[i] = Queue[2 * i];
     }
-    return H1;
+
+    H = Queue[0];
+    Free(Queue);
+    return H;
 }
 
 PriorityQueue Insert1(ElementType X, PriorityQueue H)
 {
     PriorityQueue SingleNode;
 
+#ifdef _SkewHeap
+    SingleNode = NewNode(X, NULL, NULL);
+#else
     SingleNode = NewNode(X, NULL, NULL, 0);
+#endif
     H = Merge(SingleNode, H);
     return H;
 }
@@ -2810,43 +7684,98 @@ List Mul(List La, List Lb)
 
 #endif
 
-#ifndef _Splay_H
+#ifdef _Splay_H
 
-static Position NullNode = NULL;
-
-Position NewNode(ElementType X, SplayTree Left, SplayTree Right)
+static Position NewNode(ElementType X, Position Left, Position Right, SplayTree T)
 {
     Position P;
-    P = (Position)Malloc(sizeof(struct SplayNode));
+    struct SplayBlock *B;
+
+    if (T->FreeList != NULL)
+    {
+        P = T->FreeList;
+        T->FreeList = P->Left;
+    }
+    else
+    {
+        if (T->Blocks == NULL || T->Used == SplayBlockSize)
+        {
+            B = (struct SplayBlock *)Malloc(sizeof(struct SplayBlock));
+            B->Next = T->Blocks;
+            T->Blocks = B;
+            T->Used = 0;
+        }
+        P = &T->Blocks->Nodes[T->Used++];
+    }
     P->Element = X;
     P->Left = Left;
     P->Right = Right;
     return P;
 }
 
-void DeleteNode(Position P)
+static void DeleteNode(Position P, SplayTree T)
 {
-    Free(P);
+    P->Left = T->FreeList;
+    T->FreeList = P;
 }
 
 SplayTree Initialize(void)
 {
-    if (NullNode == NULL)
+    SplayTree T;
+    T = (SplayTree)Malloc(sizeof(struct SplayTreeRecord));
+    T->NullNode.Left = T->NullNode.Right = &T->NullNode;
+    T->Blocks = NULL;
+    T->SplayPeriod = 1;
+    T->Accesses = 0;
+    return MakeEmpty(T);
+}
+
+void DisposeTree(SplayTree T)
+{
+    if (T != NULL)
     {
-        NullNode = (SplayTree)Malloc(sizeof(struct SplayNode));
-        NullNode->Left = NullNode->Right = NullNode;
+        MakeEmpty(T);
+        Free(T);
     }
-    return NullNode;
 }
 
+// gives every block back at once, the nodes need no walk
 SplayTree MakeEmpty(SplayTree T)
 {
-    if (T->Left)
-        MakeEmpty(T->Left);
-    if (T->Right)
-        MakeEmpty(T->Right);
-    DeleteNode(T);
-    return NULL;
+    struct SplayBlock *B, *BN;
+    for (B = T->Blocks; B != NULL; B = BN)
+    {
+        BN = B->Next;
+        Free(B);
+    }
+    T->Blocks = NULL;
+    T->Used = 0;
+    T->FreeList = NULL;
+    T->Root = &T->NullNode;
+    return T;
+}
+
+// lookups splay only on every K-th call and otherwise just descend,
+// Insert and Remove always splay
+void SetSplayPeriod(int K, SplayTree T)
+{
+    if (K < 1)
+        runtime_error("Splay period must be positive");
+    T->SplayPeriod = K;
+    T->Accesses = 0;
+}
+
+static int SplayDue(SplayTree T)
+{
+    if (++T->Accesses < T->SplayPeriod)
+        return 0;
+    T->Accesses = 0;
+    return 1;
+}
+
+int IsEmpty(SplayTree T)
+{
+    return T->Root == &T->NullNode;
 }
 
 static Position
@@ -2873,33 +7802,32 @@ SingleRotateWithRight(Position K1)
     return K2;
 }
 
-SplayTree Splay(ElementType Item, Position X)
+static Position Splay(ElementType Item, Position X, SplayTree T)
 {
-    static struct SplayNode Header;
-    Position LeftTreeMax, RightTreeMin;
+    Position LeftTreeMax, RightTreeMin, NullNode = &T->NullNode;
 
-    Header.Left = Header.Right = NullNode;
-    LeftTreeMax = RightTreeMin = &Header;
+    T->Header.Left = T->Header.Right = NullNode;
+    LeftTreeMax = RightTreeMin = &T->Header;
     NullNode->Element = Item;
 
-    while (Item != X->Element)
+    while (!ElementEqual(Item, X->Element))
     {
-        if (Item < X->Element)
+        if (ElementLess(Item, X->Element))
         {
+            if (ElementLess(Item, X->Left->Element))
+                X = SingleRotateWithLeft(X);
             if (X->Left == NullNode)
                 break;
-            if (Item < X->Left->Element)
-                X = SingleRotateWithLeft(X);
             RightTreeMin->Left = X;
             RightTreeMin = X;
             X = X->Left;
         }
         else
         {
+            if (ElementLess(X->Right->Element, Item))
+                X = SingleRotateWithRight(X);
             if (X->Right == NullNode)
                 break;
-            if (Item > X->Right->Element)
-                X = SingleRotateWithRight(X);
             LeftTreeMax->Right = X;
             LeftTreeMax = X;
             X = X->Right;
@@ -2907,99 +7835,195 @@ SplayTree Splay(ElementType Item, Position X)
     }
     LeftTreeMax->Right = X->Left;
     RightTreeMin->Left = X->Right;
-    X->Left = Header.Right; // Because L need right and R need left
-    X->Right = Header.Left;
+    X->Left = T->Header.Right; // Because L need right and R need left
+    X->Right = T->Header.Left;
 
     return X;
 }
 
-SplayTree Find(ElementType X, SplayTree T)
+Position Find(ElementType X, SplayTree T)
 {
-    if (T != NullNode)
-        T = Splay(X, T);
-    return T;
+    Position P = T->Root;
+
+    if (P == &T->NullNode)
+        return NULL;
+    if (SplayDue(T))
+    {
+        P = T->Root = Splay(X, P, T);
+        return ElementEqual(P->Element, X) ? P : NULL;
+    }
+    while (P != &T->NullNode && !ElementEqual(P->Element, X))
+    {
+        if (ElementLess(X, P->Element))
+            P = P->Left;
+        else
+            P = P->Right;
+    }
+    return P == &T->NullNode ? NULL : P;
 }
 
-SplayTree FindMin(SplayTree T)
+Position FindMin(SplayTree T)
 {
-    if (T != NullNode)
-        T = Splay(NegInfinity, T);
-    return T;
+    Position P = T->Root;
+
+    if (P == &T->NullNode)
+        return NULL;
+    while (P->Left != &T->NullNode)
+        P = P->Left;
+    if (SplayDue(T))
+        P = T->Root = Splay(P->Element, T->Root, T);
+    return P;
 }
 
-SplayTree FindMax(SplayTree T)
+Position FindMax(SplayTree T)
 {
-    if (T != NullNode)
-        T = Splay(Infinity, T);
-    return T;
+    Position P = T->Root;
+
+    if (P == &T->NullNode)
+        return NULL;
+    while (P->Right != &T->NullNode)
+        P = P->Right;
+    if (SplayDue(T))
+        P = T->Root = Splay(P->Element, T->Root, T);
+    return P;
 }
 
 SplayTree Insert(ElementType Item, SplayTree T)
 {
-    static Position NewTreeNode = NULL;
+    Position NullNode = &T->NullNode, Root = T->Root, NewTreeNode;
 
-    if (NewTreeNode == NULL)
+    if (Root == NullNode)
     {
-        NewTreeNode = NewNode(0, NullNode, NullNode);
+        T->Root = NewNode(Item, NullNode, NullNode, T);
+        return T;
     }
-    NewTreeNode->Element = Item;
-
-    if (T == NullNode)
+    Root = Splay(Item, Root, T);
+    if (ElementLess(Item, Root->Element))
     {
-        NewTreeNode->Left = NewTreeNode->Right = NullNode;
-        T = NewTreeNode;
+        NewTreeNode = NewNode(Item, Root->Left, Root, T);
+        Root->Left = NullNode;
+        Root = NewTreeNode;
     }
-    else
+    else if (ElementLess(Root->Element, Item))
     {
-        T = Splay(Item, T);
-        if (Item < T->Element)
-        {
-            NewTreeNode->Left = T->Left;
-            NewTreeNode->Right = T;
-            T->Left = NullNode;
-            T = NewTreeNode;
-        }
-        else if (T->Element < Item)
-        {
-            NewTreeNode->Right = T->Right;
-            NewTreeNode->Left = T;
-            T->Right = NullNode;
-            T = NewTreeNode;
-        }
-        else
-            return T;
+        NewTreeNode = NewNode(Item, Root, Root->Right, T);
+        Root->Right = NullNode;
+        Root = NewTreeNode;
     }
-    NewTreeNode = NULL;
+    T->Root = Root;
     return T;
 }
 
 SplayTree Remove(ElementType Item, SplayTree T)
 {
-    Position NewTree;
+    Position NewTree, Root = T->Root;
 
-    if (T != NullNode)
+    if (Root != &T->NullNode)
     {
-        T = Splay(Item, T);
-        if (Item == T->Element)
+        Root = Splay(Item, Root, T);
+        if (ElementEqual(Item, Root->Element))
         {
-            if (T->Left == NullNode)
-                NewTree = T->Right;
+            if (Root->Left == &T->NullNode)
+                NewTree = Root->Right;
             else
             {
-                NewTree = T->Left;
-                NewTree = Splay(Item, NewTree);
-                NewTree->Right = T->Right;
+                NewTree = Root->Left;
+                NewTree = Splay(Item, NewTree, T);
+                NewTree->Right = Root->Right;
             }
-            DeleteNode(T);
-            T = NewTree;
+            DeleteNode(Root, T);
+            Root = NewTree;
         }
+        T->Root = Root;
     }
     return T;
 }
 
-ElementType Retrieve(SplayTree T)
+ElementType Retrieve(Position P)
+{
+    return P->Element;
+}
+
+static void IteratorPush(Position P, struct SplayIterator *I)
 {
-    return T->Element;
+    if (I->Top + 1 == I->Capacity)
+    {
+        if (I->Stack == I->Inline)
+        {
+            I->Stack = (Position *)Malloc(sizeof(Position) * I->Capacity * 2);
+            memcpy(I->Stack, I->Inline, sizeof(Position) * I->Capacity);
+        }
+        else
+            I->Stack = (Position *)Realloc(I->Stack, sizeof(Position) * I->Capacity * 2);
+        I->Capacity *= 2;
+    }
+    I->Stack[++I->Top] = P;
+}
+
+static void PushLeft(Position P, struct SplayIterator *I)
+{
+    for (; P != I->NullNode; P = P->Left)
+        IteratorPush(P, I);
+}
+
+Position IteratorFirst(SplayTree T, struct SplayIterator *I)
+{
+    I->Stack = I->Inline;
+    I->Capacity = SplayIteratorInline;
+    I->Top = -1;
+    I->NullNode = &T->NullNode;
+    PushLeft(T->Root, I);
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+// positions I at the first element not less than X
+Position IteratorSeek(ElementType X, SplayTree T, struct SplayIterator *I)
+{
+    Position P = T->Root;
+
+    I->Stack = I->Inline;
+    I->Capacity = SplayIteratorInline;
+    I->Top = -1;
+    I->NullNode = &T->NullNode;
+    while (P != I->NullNode)
+    {
+        if (ElementLess(P->Element, X))
+            P = P->Right;
+        else
+        {
+            IteratorPush(P, I);
+            P = P->Left;
+        }
+    }
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+// NULL once the iterator runs off the end
+Position IteratorNext(struct SplayIterator *I)
+{
+    if (I->Top < 0)
+        return NULL;
+    PushLeft(I->Stack[I->Top--]->Right, I);
+    return I->Top < 0 ? NULL : I->Stack[I->Top];
+}
+
+void IteratorDispose(struct SplayIterator *I)
+{
+    if (I->Stack != I->Inline)
+        Free(I->Stack);
+    I->Stack = I->Inline;
+    I->Top = -1;
+}
+
+// calls Visit on every element in [Lo, Hi] in order
+void RangeScan(ElementType Lo, ElementType Hi, void (*Visit)(Position P, void *Arg), void *Arg, SplayTree T)
+{
+    struct SplayIterator I;
+    Position P;
+
+    for (P = IteratorSeek(Lo, T, &I); P != NULL && !ElementLess(Hi, P->Element); P = IteratorNext(&I))
+        Visit(P, Arg);
+    IteratorDispose(&I);
 }
 
 #endif
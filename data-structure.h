@@ -1,3 +1,6 @@
+#ifndef _DataStructure_H
+#define _DataStructure_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -13,10 +16,22 @@ void *Realloc(void *ptr, size_t size);
 void *Calloc(size_t nmemb, size_t size);
 void Free(void *ptr);
 
+#endif
+
 #ifndef ElementType
 #define ElementType int
 #endif
 
+// the search trees (_AvlTree_H, _RBTree_H, _Treap_H, _Splay_H), the hash
+// tables and _BinHeap_H compare through these, so a non-arithmetic
+// ElementType only needs the two macros redefined
+#ifndef ElementLess
+#define ElementLess(A, B) ((A) < (B))
+#endif
+#ifndef ElementEqual
+#define ElementEqual(A, B) ((A) == (B))
+#endif
+
 #ifdef _List_H
 
 struct Node;
@@ -49,6 +64,37 @@ struct Node
 
 #endif
 
+#ifdef _IntrusiveList_H
+
+#include <stddef.h>
+
+#ifndef ContainerOf
+#define ContainerOf(Ptr, Type, Member) ((Type *)((char *)(Ptr)-offsetof(Type, Member)))
+#endif
+
+// embed a struct ListLink in the payload; the list never allocates
+struct ListLink;
+typedef struct ListLink *Position;
+typedef struct ListLink *List;
+
+List Init(struct ListLink *L);
+int IsEmpty(List L);
+int IsLast(Position P, List L);
+Position FindPrevious(Position N, List L);
+void Insert(Position N, List L, Position P);
+Position RemoveAfter(Position P);
+void Remove(Position N, List L);
+Position Header(List L);
+Position First(List L);
+Position Advance(Position P);
+
+struct ListLink
+{
+    struct ListLink *Next;
+};
+
+#endif
+
 #ifdef _DoubleList_H
 
 struct Node;
@@ -90,41 +136,375 @@ struct ListRecord
 
 #endif
 
-#ifdef _Cursor_H
+#ifdef _IntrusiveDoubleList_H
 
-#define SpaceSize 1000010
+#include <stddef.h>
 
-typedef int PtrToNode;
-typedef PtrToNode List;
-typedef PtrToNode Position;
+#ifndef ContainerOf
+#define ContainerOf(Ptr, Type, Member) ((Type *)((char *)(Ptr)-offsetof(Type, Member)))
+#endif
 
-void InitializeCursorSpace(void);
+// circular through the header link, so Insert and Remove never test for the ends
+struct DoubleLink;
+typedef struct DoubleLink *Position;
+typedef struct DoubleLink *List;
 
-Position CursorAlloc(void);
-void CursorFree(Position P);
+List Init(struct DoubleLink *L);
+int IsEmpty(List L);
+int IsLast(Position P, List L);
+int IsLinked(Position P);
+void Insert(Position N, List L, Position P);
+void Remove(Position P);
+Position Header(List L);
+Position First(List L);
+Position Last(List L);
+Position Prev(Position P);
+Position Next(Position P);
 
-static void DeleteNode(Position P);
-static Position NewNode(ElementType X, Position PNext);
+struct DoubleLink
+{
+    struct DoubleLink *Prev;
+    struct DoubleLink *Next;
+};
+
+#endif
+
+#ifdef _XorList_H
+
+#define MinXorPoolSize (16)
+
+typedef unsigned int PtrToNode;
+struct ListRecord;
+typedef struct ListRecord *List;
+struct PositionRecord;
+typedef struct PositionRecord Position;
+
+static PtrToNode NewNode(ElementType X, List L);
+static void DeleteNode(PtrToNode P, List L);
+
+List Init();
+List MakeEmpty(List L);
+int IsEmpty(List L);
+int IsLast(Position P, List L);
+Position Find(ElementType X, List L);
+void Delete(ElementType X, List L);
+Position DeleteAt(Position P, List L);
+Position FindPrevious(ElementType X, List L);
+Position Insert(ElementType X, List L, Position P);
+void DeleteList(List L);
+Position Header(List L);
+Position First(List L);
+Position Prev(Position P, List L);
+Position Next(Position P, List L);
+ElementType Retrieve(Position P, List L);
+
+// Link is the xor of the neighbours' indices, or the next free node
+struct Node
+{
+    ElementType Element;
+    PtrToNode Link;
+};
+
+// node 0 is the header, the list is circular through it
+struct ListRecord
+{
+    struct Node *Nodes;
+    PtrToNode Capacity;
+    PtrToNode Top;
+    PtrToNode FreeList;
+    PtrToNode Last;
+};
+
+// a position carries its predecessor, the only way to walk an xor list
+struct PositionRecord
+{
+    PtrToNode Prev;
+    PtrToNode Cur;
+};
+
+#endif
 
+#ifdef _UnrolledList_H
+
+#define UnrolledNodeSize (64 / sizeof(ElementType))
+
+struct Node;
+typedef struct Node *PtrToNode;
+struct ListRecord;
+typedef struct ListRecord *List;
+struct PositionRecord;
+typedef struct PositionRecord Position;
+
+static PtrToNode NewNode(PtrToNode PPrev, PtrToNode PNext, List L);
+static void DeleteNode(PtrToNode P, List L);
+static int FindInNode(ElementType X, PtrToNode P);
+static void RemoveAt(PtrToNode P, int Index, List L);
+
+List Init();
 List MakeEmpty(List L);
-int IsEmpty(const List L);
-int IsLast(const Position P, const List L);
-Position Find(ElementType X, const List L);
+int IsEmpty(List L);
+int IsLast(Position P, List L);
+Position Find(ElementType X, List L);
 void Delete(ElementType X, List L);
-Position FindPrevious(ElementType X, const List L);
+Position FindPrevious(ElementType X, List L);
 void Insert(ElementType X, List L, Position P);
 void DeleteList(List L);
-Position Header(const List L);
-Position First(const List L);
-Position Advance(const Position P);
-ElementType Retrieve(const Position P);
+Position Header(List L);
+Position First(List L);
+Position Advance(Position P);
+Position Prev(Position P);
+ElementType Retrieve(Position P);
+
+struct Node
+{
+    int Count;
+    PtrToNode Prev;
+    PtrToNode Next;
+    ElementType Elements[UnrolledNodeSize];
+};
+
+struct ListRecord
+{
+    PtrToNode Head;
+    PtrToNode Tail;
+};
+
+struct PositionRecord
+{
+    PtrToNode Node;
+    int Index;
+};
+
+#endif
+
+#ifdef _SkipList_H
+
+#define MaxLevel (32)
+#define RandomA 48271L
+#define RandomM 2147483647L
+#define RandomQ (RandomM / RandomA)
+#define RandomR (RandomM % RandomA)
+
+struct Node;
+typedef struct Node *Position;
+struct SkipListRecord;
+typedef struct SkipListRecord *SkipList;
+
+static Position NewNode(ElementType X, int Level);
+static void DeleteNode(Position P);
+static int RandomLevel(SkipList L);
+static Position FindLess(ElementType X, SkipList L, Position Update[]);
+
+SkipList Init(void);
+void SetSeed(unsigned long InitVal, SkipList L);
+SkipList MakeEmpty(SkipList L);
+void DeleteList(SkipList L);
+int IsEmpty(SkipList L);
+Position Find(ElementType X, SkipList L);
+Position Seek(ElementType X, SkipList L);
+void Insert(ElementType X, SkipList L);
+void Delete(ElementType X, SkipList L);
+Position First(SkipList L);
+Position Advance(Position P);
+ElementType Retrieve(Position P);
+
 struct Node
 {
     ElementType Element;
-    Position Next;
+    int Level;
+    Position Next[];
+};
+
+struct SkipListRecord
+{
+    Position Head;
+    int Level;
+    unsigned long Seed;
+};
+
+#endif
+
+#ifdef _ConcurrentSkipList_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define MaxLevel (32)
+#define MaxRetired (64)
+#define RandomA 48271L
+#define RandomM 2147483647L
+#define RandomQ (RandomM / RandomA)
+#define RandomR (RandomM % RandomA)
+
+struct Node;
+typedef struct Node *Position;
+struct SkipListRecord;
+typedef struct SkipListRecord *SkipList;
+
+static Position NewNode(ElementType X, int Level);
+static void DeleteNode(Position P);
+static int RandomLevel(SkipList L);
+static Position FindLess(ElementType X, SkipList L, Position Update[]);
+static void Synchronize(SkipList L);
+
+SkipList Init(void);
+void SetSeed(unsigned long InitVal, SkipList L);
+void DeleteList(SkipList L);
+int IsEmpty(SkipList L);
+int ReadLock(SkipList L);
+void ReadUnlock(int Phase, SkipList L);
+Position Find(ElementType X, SkipList L);
+Position Seek(ElementType X, SkipList L);
+void Insert(ElementType X, SkipList L);
+void Delete(ElementType X, SkipList L);
+void Reclaim(SkipList L);
+Position First(SkipList L);
+Position Advance(Position P);
+ElementType Retrieve(Position P);
+
+struct Node
+{
+    ElementType Element;
+    int Level;
+    Position Retired;
+    _Atomic(Position) Next[];
+};
+
+struct SkipListRecord
+{
+    Position Head;
+    atomic_int Level;
+    unsigned long Seed;
+    pthread_mutex_t WriteLock;
+    atomic_int Phase;
+    atomic_long Readers[2];
+    Position Retired;
+    int NumRetired;
+};
+
+#endif
+
+#ifdef _LockFreeList_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define AdvanceThreshold (32)
+
+struct Node;
+typedef struct Node *Position;
+struct ThreadRecord;
+typedef struct ThreadRecord *ThreadHandle;
+struct ListRecord;
+typedef struct ListRecord *List;
+
+static Position NewNode(ElementType X, Position PNext);
+static void DeleteNode(Position P);
+static void FreeLimbo(ThreadHandle R, int i);
+static void Enter(List L, ThreadHandle R);
+static void Leave(ThreadHandle R);
+static void TryAdvance(List L);
+static void Retire(Position P, List L, ThreadHandle R);
+static int Search(ElementType X, List L, ThreadHandle R, _Atomic(uintptr_t) **PrevLink, Position *Cur);
+
+List Init(void);
+void DeleteList(List L);
+ThreadHandle AttachThread(List L);
+void DetachThread(ThreadHandle R);
+int IsEmpty(List L);
+int Find(ElementType X, List L, ThreadHandle R);
+int Insert(ElementType X, List L, ThreadHandle R);
+int Delete(ElementType X, List L, ThreadHandle R);
+
+#define IsMarked(Word) ((Word)&1)
+#define Unmark(Word) ((Position)((Word) & ~(uintptr_t)1))
+
+struct Node
+{
+    ElementType Element;
+    _Atomic(uintptr_t) Next;
+    Position Retired;
 };
 
-struct Node CursorSpace[SpaceSize];
+struct ThreadRecord
+{
+    atomic_uint State;
+    atomic_int InUse;
+    ThreadHandle Next;
+    Position Limbo[3];
+    unsigned int LimboEpoch[3];
+    int NumRetired;
+};
+
+struct ListRecord
+{
+    Position Head;
+    atomic_uint GlobalEpoch;
+    _Atomic(ThreadHandle) Records;
+};
+
+#endif
+
+#ifdef _Cursor_H
+
+#define CursorChunkShift (12)
+#define CursorChunkSize (1u << CursorChunkShift)
+#define MaxCursorChunks (1u << (32 - CursorChunkShift))
+#define CursorScanBlock (16)
+
+typedef unsigned int PtrToNode;
+typedef PtrToNode List;
+typedef PtrToNode Position;
+struct CursorSpaceRecord;
+typedef struct CursorSpaceRecord *CursorSpace;
+
+CursorSpace CreateCursorSpace(void);
+void DisposeCursorSpace(CursorSpace S);
+
+Position CursorAlloc(CursorSpace S);
+void CursorFree(Position P, CursorSpace S);
+Position CursorAllocRange(unsigned int N, CursorSpace S);
+void CursorFreeRange(Position First, Position Last, CursorSpace S);
+
+static void AddChunk(CursorSpace S);
+static Position CursorAllocContiguous(unsigned int N, CursorSpace S);
+static void DeleteNode(Position P, CursorSpace S);
+static Position NewNode(ElementType X, Position PNext, CursorSpace S);
+
+List Init(CursorSpace S);
+List MakeEmpty(List L, CursorSpace S);
+int IsEmpty(const List L, CursorSpace S);
+int IsLast(const Position P, const List L, CursorSpace S);
+Position Find(ElementType X, const List L, CursorSpace S);
+void Delete(ElementType X, List L, CursorSpace S);
+Position FindPrevious(ElementType X, const List L, CursorSpace S);
+void Insert(ElementType X, List L, Position P, CursorSpace S);
+void DeleteList(List L, CursorSpace S);
+void Compact(List L, CursorSpace S);
+Position Header(const List L);
+Position First(const List L, CursorSpace S);
+Position Advance(const Position P, CursorSpace S);
+ElementType Retrieve(const Position P, CursorSpace S);
+
+// structure of arrays, so a scan over elements does not drag the links along
+struct CursorChunk
+{
+    ElementType Element[CursorChunkSize];
+    Position Next[CursorChunkSize];
+};
+
+// index 0 is the null cursor and heads the free list
+struct CursorSpaceRecord
+{
+    struct CursorChunk **Chunks;
+    unsigned int NumChunks;
+    unsigned int MaxChunks;
+    Position Top;
+};
+
+#define CursorElement(P, S) ((S)->Chunks[(P) >> CursorChunkShift]->Element[(P) & (CursorChunkSize - 1)])
+#define CursorNext(P, S) ((S)->Chunks[(P) >> CursorChunkShift]->Next[(P) & (CursorChunkSize - 1)])
 
 #endif
 
@@ -158,24 +538,30 @@ struct Node
 struct StackRecord;
 typedef struct StackRecord *Stack;
 
+static void Reserve(int Needed, Stack S);
 int IsEmpty(Stack S);
 int IsFull(Stack S);
 Stack CreateStack(int MaxElements);
+Stack InitStack(struct StackRecord *S);
+void FreeStack(Stack S);
 void DisposeStack(Stack S);
 void MakeEmpty(Stack S);
 void Push(ElementType X, Stack S);
+void PushN(const ElementType *X, int N, Stack S);
 ElementType Top(Stack S);
 void Pop(Stack S);
+void PopN(ElementType *X, int N, Stack S);
 ElementType TopAndPop(Stack S);
 
 #define EmptyTOS (-1)
-#define MinStackSize (5)
+#define StackInlineSize (16)
 
 struct StackRecord
 {
     int Capacity;
     int TopOfStack;
     ElementType *Array;
+    ElementType Inline[StackInlineSize];
 };
 
 #endif
@@ -209,6 +595,89 @@ struct QueueRecord
 
 #endif
 
+#ifdef _SpscQueue_h
+
+#include <stdatomic.h>
+
+#define MinQueueSize (5)
+#define CacheLineSize (64)
+
+struct QueueRecord;
+typedef struct QueueRecord *Queue;
+
+static unsigned long RoundUpPowerOfTwo(unsigned long Value);
+Queue CreateQueue(int MaxElements);
+void DisposeQueue(Queue Q);
+int IsEmpty(Queue Q);
+int IsFull(Queue Q);
+int TryEnqueue(ElementType X, Queue Q);
+int TryDequeue(ElementType *X, Queue Q);
+void Enqueue(ElementType X, Queue Q);
+ElementType FrontAndDequeue(Queue Q);
+int EnqueueN(const ElementType *X, int N, Queue Q);
+int DequeueN(ElementType *X, int N, Queue Q);
+
+struct QueueRecord
+{
+    unsigned long Mask;
+    ElementType *Array;
+    char Pad0[CacheLineSize - sizeof(unsigned long) - sizeof(ElementType *)];
+
+    atomic_ulong Front;
+    unsigned long RearCache;
+    char Pad1[CacheLineSize - sizeof(atomic_ulong) - sizeof(unsigned long)];
+
+    atomic_ulong Rear;
+    unsigned long FrontCache;
+    char Pad2[CacheLineSize - sizeof(atomic_ulong) - sizeof(unsigned long)];
+};
+
+#endif
+
+#ifdef _MpmcQueue_h
+
+#include <stdatomic.h>
+
+#define MinQueueSize (5)
+#define CacheLineSize (64)
+
+struct QueueCell;
+struct QueueRecord;
+typedef struct QueueRecord *Queue;
+
+static unsigned long RoundUpPowerOfTwo(unsigned long Value);
+Queue CreateQueue(int MaxElements);
+void DisposeQueue(Queue Q);
+int IsEmpty(Queue Q);
+int IsFull(Queue Q);
+int TryEnqueue(ElementType X, Queue Q);
+int TryDequeue(ElementType *X, Queue Q);
+void Enqueue(ElementType X, Queue Q);
+ElementType FrontAndDequeue(Queue Q);
+int EnqueueN(const ElementType *X, int N, Queue Q);
+int DequeueN(ElementType *X, int N, Queue Q);
+
+struct QueueCell
+{
+    atomic_ulong Sequence;
+    ElementType Element;
+};
+
+struct QueueRecord
+{
+    unsigned long Mask;
+    struct QueueCell *Cells;
+    char Pad0[CacheLineSize - sizeof(unsigned long) - sizeof(struct QueueCell *)];
+
+    atomic_ulong Front;
+    char Pad1[CacheLineSize - sizeof(atomic_ulong)];
+
+    atomic_ulong Rear;
+    char Pad2[CacheLineSize - sizeof(atomic_ulong)];
+};
+
+#endif
+
 #ifdef _Queue_H
 
 struct Node;
@@ -234,30 +703,193 @@ ElementType FrontAndDequeue(Queue Q);
 struct Node
 {
     ElementType Element;
-    PtrToNode Next;
+    PtrToNode Next;
+};
+
+struct QueueRecord
+{
+    PtrToNode Front;
+    PtrToNode Rear;
+    int Size;
+};
+
+#endif
+
+#ifdef _IntrusiveQueue_H
+
+#include <stddef.h>
+
+#ifndef ContainerOf
+#define ContainerOf(Ptr, Type, Member) ((Type *)((char *)(Ptr)-offsetof(Type, Member)))
+#endif
+
+struct QueueLink;
+typedef struct QueueLink *PtrToNode;
+struct QueueRecord;
+typedef struct QueueRecord *Queue;
+
+Queue InitQueue(struct QueueRecord *Q);
+int IsEmpty(Queue Q);
+void MakeEmpty(Queue Q);
+void Enqueue(PtrToNode X, Queue Q);
+PtrToNode Front(Queue Q);
+void Dequeue(Queue Q);
+PtrToNode FrontAndDequeue(Queue Q);
+
+struct QueueLink
+{
+    struct QueueLink *Next;
+};
+
+struct QueueRecord
+{
+    PtrToNode Front;
+    PtrToNode Rear;
+    int Size;
+};
+
+#endif
+
+#ifdef _LockFreeQueue_H
+
+#include <stdatomic.h>
+
+#define CacheLineSize (64)
+#define HazardsPerThread (2)
+#define RetireThreshold (64)
+#define MaxFreeNodes (256)
+
+struct Node;
+typedef struct Node *PtrToNode;
+struct ThreadRecord;
+typedef struct ThreadRecord *ThreadHandle;
+struct QueueRecord;
+typedef struct QueueRecord *Queue;
+
+static PtrToNode NewNode(ElementType X, Queue Q, ThreadHandle R);
+static void Retire(PtrToNode P, Queue Q, ThreadHandle R);
+static void Scan(Queue Q, ThreadHandle R);
+static void DeleteChain(PtrToNode P);
+
+Queue CreateQueue(void);
+void DisposeQueue(Queue Q);
+ThreadHandle AttachThread(Queue Q);
+void DetachThread(ThreadHandle R);
+int IsEmpty(Queue Q);
+void Enqueue(ElementType X, Queue Q, ThreadHandle R);
+int TryDequeue(ElementType *X, Queue Q, ThreadHandle R);
+
+struct Node
+{
+    ElementType Element;
+    _Atomic(PtrToNode) Next;
+    PtrToNode FreeNext;
+};
+
+struct ThreadRecord
+{
+    _Atomic(PtrToNode) Hazard[HazardsPerThread];
+    atomic_int Active;
+    ThreadHandle Next;
+    PtrToNode Retired;
+    int NumRetired;
+    PtrToNode FreeNodes;
+    int NumFree;
+    PtrToNode *Snapshot;
+    int SnapshotSize;
 };
 
 struct QueueRecord
 {
-    PtrToNode Front;
-    PtrToNode Rear;
+    _Atomic(PtrToNode) Front;
+    char Pad0[CacheLineSize - sizeof(_Atomic(PtrToNode))];
+    _Atomic(PtrToNode) Rear;
+    char Pad1[CacheLineSize - sizeof(_Atomic(PtrToNode))];
+    _Atomic(PtrToNode) FreePool;
+    _Atomic(ThreadHandle) Records;
+    atomic_int NumRecords;
+};
+
+#endif
+
+#ifdef _TimingWheel_H
+
+#define WheelRootBits (8)
+#define WheelLevelBits (6)
+#define WheelLevels (4)
+#define WheelRootSize (1 << WheelRootBits)
+#define WheelLevelSize (1 << WheelLevelBits)
+#define MaxTimerDelay ((1UL << (WheelRootBits + WheelLevels * WheelLevelBits)) - 1)
+
+struct TimerNode;
+typedef struct TimerNode *Timer;
+struct TimerList;
+struct WheelRecord;
+typedef struct WheelRecord *TimingWheel;
+typedef void (*TimerCallback)(ElementType X);
+
+static Timer NewTimer(ElementType X, unsigned long Expires, TimingWheel W);
+static void DeleteTimer(Timer T, TimingWheel W);
+static void Append(Timer T, struct TimerList *L);
+static void Unlink(Timer T);
+static void PlaceTimer(Timer T, TimingWheel W);
+static void Cascade(struct TimerList *L, TimingWheel W);
+static void FreeList(struct TimerList *L);
+
+TimingWheel CreateTimingWheel(void);
+void DisposeTimingWheel(TimingWheel W);
+int IsEmpty(TimingWheel W);
+Timer AddTimer(ElementType X, unsigned long Delay, TimingWheel W);
+void RearmTimer(Timer T, unsigned long Delay, TimingWheel W);
+void CancelTimer(Timer T, TimingWheel W);
+void Tick(TimingWheel W, TimerCallback Expire);
+void Advance(unsigned long Ticks, TimingWheel W, TimerCallback Expire);
+
+struct TimerNode
+{
+    ElementType Element;
+    unsigned long Expires;
+    Timer Prev;
+    Timer Next;
+    struct TimerList *Slot;
+};
+
+struct TimerList
+{
+    Timer Front;
+    Timer Rear;
+};
+
+struct WheelRecord
+{
+    unsigned long Current;
     int Size;
+    Timer FreeTimers;
+    Timer Firing;
+    struct TimerList Root[WheelRootSize];
+    struct TimerList Levels[WheelLevels][WheelLevelSize];
 };
 
 #endif
 
 #ifdef _Deque_h
 
+#define DequeBlockSize (64)
+#define MinDequeMapSize (8)
+#define MaxSpareBlocks (4)
+
 struct DequeRecord;
 typedef struct DequeRecord *Deque;
 
+static ElementType *AllocBlock(Deque D);
+static void ReleaseBlock(ElementType *Block, Deque D);
+static void GrowMap(Deque D);
+static ElementType *Slot(int Index, Deque D);
 int IsEmpty(Deque D);
 int IsFull(Deque D);
 Deque CreateDeque(int MaxElements);
 void DisposeDeque(Deque D);
 void MakeEmpty(Deque D);
-static int Succ(int Value, Deque D);
-static int Prev(int Value, Deque D);
 void Push(ElementType X, Deque D);
 void Pop(Deque D);
 void Inject(ElementType X, Deque D);
@@ -267,15 +899,110 @@ ElementType Rear(Deque D);
 ElementType FrontAndPop(Deque D);
 ElementType RearAndEject(Deque D);
 
-#define MinDequeSize (5)
-
 struct DequeRecord
 {
-    int Capacity;
+    int MapSize;
     int Front;
-    int Rear;
     int Size;
-    ElementType *Array;
+    ElementType **Map;
+    int NumSpare;
+    ElementType *Spare[MaxSpareBlocks];
+};
+
+#endif
+
+#ifdef _WorkStealDeque_h
+
+#include <stdatomic.h>
+
+#define MinDequeSize (5)
+#define CacheLineSize (64)
+
+struct DequeArray;
+struct DequeRecord;
+typedef struct DequeRecord *Deque;
+
+static struct DequeArray *NewArray(long Capacity, struct DequeArray *Prev);
+static struct DequeArray *Grow(Deque D, struct DequeArray *A, long Bottom, long Top);
+Deque CreateDeque(int MaxElements);
+void DisposeDeque(Deque D);
+int IsEmpty(Deque D);
+void Push(ElementType X, Deque D);
+int Pop(ElementType *X, Deque D);
+int Steal(ElementType *X, Deque D);
+
+struct DequeArray
+{
+    long Mask;
+    struct DequeArray *Prev;
+    _Atomic(ElementType) *Buffer;
+};
+
+struct DequeRecord
+{
+    atomic_long Top;
+    char Pad0[CacheLineSize - sizeof(atomic_long)];
+    atomic_long Bottom;
+    _Atomic(struct DequeArray *) Array;
+    char Pad1[CacheLineSize - sizeof(atomic_long) - sizeof(struct DequeArray *)];
+};
+
+#endif
+
+#ifdef _TaskPool_H
+
+#include <pthread.h>
+#include <sched.h>
+
+#ifndef _WorkStealDeque_h
+#error "_TaskPool_H needs _WorkStealDeque_h with ElementType defined as struct Task *"
+#endif
+
+typedef void (*TaskFunction)(void *Arg);
+
+struct Task;
+struct Worker;
+struct PoolRecord;
+typedef struct PoolRecord *TaskPool;
+
+static struct Task *FindTask(TaskPool P, struct Worker *W);
+static void RunTask(struct Task *T);
+static void *WorkerLoop(void *Arg);
+TaskPool CreateTaskPool(int NumWorkers);
+void DisposeTaskPool(TaskPool P);
+void Spawn(TaskFunction Func, void *Arg, atomic_int *Pending, TaskPool P);
+void Wait(atomic_int *Pending, TaskPool P);
+
+struct Task
+{
+    TaskFunction Func;
+    void *Arg;
+    atomic_int *Pending;
+    struct Task *Next;
+};
+
+_Static_assert(_Generic((ElementType)0, struct Task * : 1, default : 0),
+               "_TaskPool_H needs ElementType defined as struct Task *");
+
+struct Worker
+{
+    Deque D;
+    TaskPool Pool;
+    pthread_t Thread;
+    unsigned int Seed;
+};
+
+struct PoolRecord
+{
+    int NumWorkers;
+    struct Worker *Workers;
+    pthread_mutex_t Lock;
+    pthread_cond_t Wake;
+    struct Task *InjectFront;
+    struct Task *InjectRear;
+    atomic_int NumQueued;
+    atomic_int NumSleeping;
+    atomic_int Stop;
 };
 
 #endif
@@ -294,9 +1021,12 @@ struct TreeNode
 
 #ifdef _Tree_H
 
+#define TreeIteratorInline (64)
+
 struct TreeNode;
 typedef struct TreeNode *Position;
 typedef struct TreeNode *SearchTree;
+struct TreeIterator;
 
 static SearchTree NewNode(ElementType X, SearchTree Left, SearchTree Right);
 static void DeleteNode(SearchTree T);
@@ -310,21 +1040,49 @@ SearchTree Delete(ElementType X, SearchTree T);
 ElementType Retrieve(Position P);
 Position FindPrev(ElementType X, SearchTree T);
 Position FindNext(ElementType X, SearchTree T);
+#ifdef ValueType
+ValueType *FindValue(ElementType Key, SearchTree T);
+ValueType *InsertOrAssign(ElementType Key, ValueType Value, SearchTree *T);
+ValueType *Upsert(ElementType Key, SearchTree *T);
+#endif
+static void IteratorPush(Position P, struct TreeIterator *I);
+static void PushLeft(Position P, struct TreeIterator *I);
+Position IteratorFirst(SearchTree T, struct TreeIterator *I);
+Position IteratorSeek(ElementType X, SearchTree T, struct TreeIterator *I);
+Position IteratorNext(struct TreeIterator *I);
+void IteratorDispose(struct TreeIterator *I);
+void RangeScan(ElementType Lo, ElementType Hi, void (*Visit)(Position P, void *Arg), void *Arg, SearchTree T);
 
 struct TreeNode
 {
     ElementType Element;
+#ifdef ValueType
+    ValueType Value;
+#endif
     SearchTree Left;
     SearchTree Right;
 };
 
+// the top of Stack is the current node, the rest are the ancestors still
+// to be visited; the stack only goes to the heap past TreeIteratorInline
+struct TreeIterator
+{
+    Position *Stack;
+    int Top;
+    int Capacity;
+    Position Inline[TreeIteratorInline];
+};
+
 #endif
 
 #ifdef _Tree_H_NR
 
+#define TreeIteratorInline (64)
+
 struct TreeNode;
 typedef struct TreeNode *Position;
 typedef struct TreeNode *SearchTree;
+struct TreeIterator;
 typedef struct TreeNode **LinkLine;
 
 static SearchTree NewNode(ElementType X, SearchTree Left, SearchTree Right);
@@ -340,6 +1098,13 @@ void Delete(ElementType X, LinkLine LT);
 ElementType Retrieve(Position P);
 Position FindPrev(ElementType X, SearchTree T);
 Position FindNext(ElementType X, SearchTree T);
+static void IteratorPush(Position P, struct TreeIterator *I);
+static void PushLeft(Position P, struct TreeIterator *I);
+Position IteratorFirst(SearchTree T, struct TreeIterator *I);
+Position IteratorSeek(ElementType X, SearchTree T, struct TreeIterator *I);
+Position IteratorNext(struct TreeIterator *I);
+void IteratorDispose(struct TreeIterator *I);
+void RangeScan(ElementType Lo, ElementType Hi, void (*Visit)(Position P, void *Arg), void *Arg, SearchTree T);
 
 struct TreeNode
 {
@@ -348,13 +1113,39 @@ struct TreeNode
     SearchTree Right;
 };
 
+// the top of Stack is the current node, the rest are the ancestors still
+// to be visited; the stack only goes to the heap past TreeIteratorInline
+struct TreeIterator
+{
+    Position *Stack;
+    int Top;
+    int Capacity;
+    Position Inline[TreeIteratorInline];
+};
+
 #endif
 
 #ifdef _AvlTree_H
 
+// an AVL tree of height 96 would need more than 2^64 nodes
+#define AvlMaxDepth (96)
+
+#define AvlUnion (0)
+#define AvlIntersection (1)
+#define AvlDifference (2)
+
+#ifdef _AvlTree_Parallel
+#include <pthread.h>
+
+// fork only this many levels deep, and only for subtrees at least this high
+#define AvlParallelDepth (3)
+#define AvlParallelHeight (12)
+#endif
+
 struct AvlNode;
 typedef struct AvlNode *Position;
 typedef struct AvlNode *AvlTree;
+struct AvlIterator;
 
 static AvlTree NewNode(ElementType X, AvlTree Left, AvlTree Right, int Height);
 static void DeleteNode(AvlTree T);
@@ -368,7 +1159,19 @@ static Position DoubleRotateWithRight(Position K1);
 
 static int GetHeight(Position P);
 static void UpdateHeight(Position P);
+#ifdef _AvlTree_Size
+static int GetSize(Position P);
+static void UpdateSize(Position P);
+static int CountBelow(ElementType X, int OrEqual, AvlTree T);
+#endif
 static AvlTree TryRotate(AvlTree T);
+static void Rebalance(AvlTree *Path[], int Depth);
+static Position InsertNode(ElementType X, AvlTree *T);
+static AvlTree BuildRange(ElementType A[], int Lo, int Hi);
+static AvlTree JoinRight(AvlTree L, Position K, AvlTree R);
+static AvlTree JoinLeft(AvlTree L, Position K, AvlTree R);
+static AvlTree DetachMin(AvlTree T, Position *Min);
+static AvlTree SetOp(AvlTree T1, AvlTree T2, int Op, int Depth);
 AvlTree MakeEmpty(AvlTree T);
 Position Find(ElementType X, AvlTree T);
 Position FindMin(AvlTree T);
@@ -378,13 +1181,287 @@ AvlTree Delete(ElementType X, AvlTree T);
 ElementType Retrieve(Position P);
 Position FindPrev(ElementType X, AvlTree T);
 Position FindNext(ElementType X, AvlTree T);
+AvlTree BuildFromSorted(ElementType A[], int N);
+AvlTree JoinNode(AvlTree L, Position K, AvlTree R);
+AvlTree Join(AvlTree L, AvlTree R);
+int Split(ElementType X, AvlTree T, AvlTree *L, AvlTree *R);
+AvlTree Union(AvlTree T1, AvlTree T2);
+AvlTree Intersection(AvlTree T1, AvlTree T2);
+AvlTree Difference(AvlTree T1, AvlTree T2);
+Position IteratorFirst(AvlTree T, struct AvlIterator *I);
+Position IteratorSeek(ElementType X, AvlTree T, struct AvlIterator *I);
+Position IteratorNext(struct AvlIterator *I);
+void RangeScan(ElementType Lo, ElementType Hi, void (*Visit)(Position P, void *Arg), void *Arg, AvlTree T);
+#ifdef ValueType
+ValueType *FindValue(ElementType Key, AvlTree T);
+ValueType *InsertOrAssign(ElementType Key, ValueType Value, AvlTree *T);
+ValueType *Upsert(ElementType Key, AvlTree *T);
+#endif
+#ifdef _AvlTree_Size
+int Rank(ElementType X, AvlTree T);
+Position Select(int K, AvlTree T);
+int CountRange(ElementType Lo, ElementType Hi, AvlTree T);
+#endif
+
+struct AvlNode
+{
+    ElementType Element;
+#ifdef ValueType
+    ValueType Value;
+#endif
+    AvlTree Left;
+    AvlTree Right;
+    int Height;
+#ifdef _AvlTree_Size
+    int Size;
+#endif
+};
+
+// the height bound makes a fixed stack enough, so iterating never allocates
+struct AvlIterator
+{
+    Position Stack[AvlMaxDepth];
+    int Top;
+};
+
+#ifdef _AvlTree_Parallel
+struct SetOpArgs
+{
+    AvlTree T1;
+    AvlTree T2;
+    AvlTree Result;
+    int Op;
+    int Depth;
+};
+
+static void *SetOpThread(void *Arg);
+#endif
+
+#endif
+
+#ifdef _CompactAvl_H
+
+#define AvlMaxDepth (96)
+#define MinAvlPoolSize (16)
+#define MaxAvlPoolSize (1u << 30)
+
+// nodes are 32-bit pool indices, 0 is the empty tree
+typedef unsigned int Position;
+struct AvlNode;
+struct AvlTreeRecord;
+typedef struct AvlTreeRecord *AvlTree;
+
+static Position NewNode(ElementType X, AvlTree T);
+static void DeleteNode(Position P, AvlTree T);
+
+static Position GetLeft(Position P, AvlTree T);
+static Position GetRight(Position P, AvlTree T);
+static int GetBalance(Position P, AvlTree T);
+static void SetLeft(Position P, Position C, AvlTree T);
+static void SetRight(Position P, Position C, AvlTree T);
+static void SetBalance(Position P, int B, AvlTree T);
+static void SetChild(Position Path[], int Dir[], int Depth, Position C, AvlTree T);
+
+static Position RotateWithLeft(Position P, AvlTree T);
+static Position RotateWithRight(Position P, AvlTree T);
+static Position FixBalance(Position P, int B, int *Shrunk, AvlTree T);
+
+AvlTree CreateTree(void);
+void DisposeTree(AvlTree T);
+AvlTree MakeEmpty(AvlTree T);
+Position Find(ElementType X, AvlTree T);
+Position FindMin(AvlTree T);
+Position FindMax(AvlTree T);
+AvlTree Insert(ElementType X, AvlTree T);
+AvlTree Delete(ElementType X, AvlTree T);
+ElementType Retrieve(Position P, AvlTree T);
+Position FindPrev(ElementType X, AvlTree T);
+Position FindNext(ElementType X, AvlTree T);
+
+// Left holds the child index shifted up by two and the balance
+// factor (right height - left height) plus one in the low bits
+struct AvlNode
+{
+    ElementType Element;
+    unsigned int Left;
+    unsigned int Right;
+};
+
+struct AvlTreeRecord
+{
+    struct AvlNode *Nodes;
+    unsigned int Capacity;
+    unsigned int Top;
+    Position FreeList;
+    Position Root;
+};
+
+#endif
+
+#ifdef _PersistentAvl_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+struct AvlNode;
+typedef struct AvlNode *Position;
+typedef struct AvlNode *AvlTree;
+struct ReaderRecord;
+typedef struct ReaderRecord *ReaderHandle;
+struct PersistentAvlRecord;
+typedef struct PersistentAvlRecord *PersistentAvl;
+
+static Position NewNode(ElementType X, AvlTree Left, AvlTree Right, PersistentAvl T);
+static void DeleteNode(Position P);
+static void Retire(Position P, PersistentAvl T);
+static void FreeLimbo(int i, PersistentAvl T);
+static void TryAdvance(PersistentAvl T);
+static Position Own(Position P, PersistentAvl T);
+static void Publish(AvlTree Root, PersistentAvl T);
+
+static int Max(int ValueA, int ValueB);
+static int GetHeight(Position P);
+static void UpdateHeight(Position P);
+static Position RotateWithLeft(Position K2, PersistentAvl T);
+static Position RotateWithRight(Position K1, PersistentAvl T);
+static AvlTree TryRotate(AvlTree N, PersistentAvl T);
+static AvlTree InsertCopy(ElementType X, AvlTree N, PersistentAvl T);
+static AvlTree DeleteCopy(ElementType X, AvlTree N, PersistentAvl T);
+static AvlTree DeleteMinCopy(AvlTree N, Position *Min, PersistentAvl T);
+
+PersistentAvl CreateTree(void);
+void DisposeTree(PersistentAvl T);
+ReaderHandle AttachReader(PersistentAvl T);
+void DetachReader(ReaderHandle R);
+AvlTree ReadLock(ReaderHandle R);
+void ReadUnlock(ReaderHandle R);
+Position Find(ElementType X, AvlTree Root);
+Position FindMin(AvlTree Root);
+Position FindMax(AvlTree Root);
+ElementType Retrieve(Position P);
+AvlTree Insert(ElementType X, PersistentAvl T);
+AvlTree Delete(ElementType X, PersistentAvl T);
 
+// published nodes are never written again; a node made during the
+// current update carries its Version and may still be changed in place
 struct AvlNode
 {
     ElementType Element;
     AvlTree Left;
     AvlTree Right;
     int Height;
+    unsigned long Version;
+    Position Retired;
+};
+
+// State is (epoch << 1) | 1 while the reader holds a snapshot
+struct ReaderRecord
+{
+    atomic_uint State;
+    atomic_int InUse;
+    PersistentAvl Tree;
+    ReaderHandle Next;
+};
+
+struct PersistentAvlRecord
+{
+    _Atomic(AvlTree) Root;
+    pthread_mutex_t WriteLock;
+    unsigned long Version;
+    atomic_uint GlobalEpoch;
+    _Atomic(ReaderHandle) Readers;
+    Position Pending;
+    Position Limbo[3];
+    unsigned int LimboEpoch[3];
+};
+
+#endif
+
+#ifdef _RBTree_H
+
+#define RBRed (0)
+#define RBBlack (1)
+
+struct RBNode;
+typedef struct RBNode *Position;
+typedef struct RBNode *RBTree;
+
+static RBTree NewNode(ElementType X, Position Parent);
+static void DeleteNode(Position P);
+static int IsBlack(Position P);
+static RBTree RotateLeft(Position X, RBTree T);
+static RBTree RotateRight(Position X, RBTree T);
+static RBTree InsertFixup(Position Z, RBTree T);
+static RBTree DeleteFixup(Position X, Position Parent, RBTree T);
+
+RBTree MakeEmpty(RBTree T);
+Position Find(ElementType X, RBTree T);
+Position FindMin(RBTree T);
+Position FindMax(RBTree T);
+RBTree Insert(ElementType X, RBTree T);
+RBTree Delete(ElementType X, RBTree T);
+ElementType Retrieve(Position P);
+Position FindPrev(ElementType X, RBTree T);
+Position FindNext(ElementType X, RBTree T);
+
+struct RBNode
+{
+    ElementType Element;
+    RBTree Left;
+    RBTree Right;
+    RBTree Parent;
+    int Color;
+};
+
+#endif
+
+#ifdef _Treap_H
+
+#define RandomA 48271L
+#define RandomM 2147483647L
+#define RandomQ (RandomM / RandomA)
+#define RandomR (RandomM % RandomA)
+
+struct TreapNode;
+typedef struct TreapNode *Position;
+struct TreapRecord;
+typedef struct TreapRecord *Treap;
+
+static Position NewNode(ElementType X, Treap T);
+static void DeleteNode(Position P);
+static long RandomPriority(Treap T);
+static Position SingleRotateWithLeft(Position K2);
+static Position SingleRotateWithRight(Position K1);
+static Position InsertNode(ElementType X, Position P, Treap T);
+
+Treap Initialize(void);
+void DisposeTree(Treap T);
+void SetSeed(unsigned long InitVal, Treap T);
+int IsEmpty(Treap T);
+Treap MakeEmpty(Treap T);
+Position Find(ElementType X, Treap T);
+Position FindMin(Treap T);
+Position FindMax(Treap T);
+Treap Insert(ElementType X, Treap T);
+Treap Delete(ElementType X, Treap T);
+ElementType Retrieve(Position P);
+Position FindPrev(ElementType X, Treap T);
+Position FindNext(ElementType X, Treap T);
+
+// a binary search tree on Element and a min-heap on Priority
+struct TreapNode
+{
+    ElementType Element;
+    Position Left;
+    Position Right;
+    long Priority;
+};
+
+// each treap draws priorities from its own generator
+struct TreapRecord
+{
+    Position Root;
+    unsigned long Seed;
 };
 
 #endif
@@ -397,8 +1474,11 @@ struct ListNode;
 typedef struct ListNode *Position;
 struct HashTbl;
 typedef struct HashTbl *HashTable;
+typedef Position List;
 
+#ifndef ElementHash
 char *ConvertToString(ElementType KeyValue);
+#endif
 
 typedef unsigned int Index;
 Index Hash(ElementType KeyValue, int TableSize);
@@ -414,15 +1494,21 @@ void DestroyTable(HashTable H);
 Position Find(ElementType Key, HashTable H);
 void Insert(ElementType Key, HashTable H);
 ElementType Retrieve(Position P);
+#ifdef ValueType
+ValueType *FindValue(ElementType Key, HashTable H);
+ValueType *InsertOrAssign(ElementType Key, ValueType Value, HashTable H);
+ValueType *Upsert(ElementType Key, HashTable H);
+#endif
 
 struct ListNode
 {
     ElementType Element;
+#ifdef ValueType
+    ValueType Value;
+#endif
     Position Next;
 };
 
-typedef Position List;
-
 struct HashTbl
 {
     int TableSize;
@@ -441,7 +1527,9 @@ typedef Index Position;
 struct HashTbl;
 typedef struct HashTbl *HashTable;
 
+#ifndef ElementHash
 char *ConvertToString(ElementType KeyValue);
+#endif
 Index Hash(ElementType KeyValue, int TableSize);
 
 static int IsPrime(int Value);
@@ -453,6 +1541,11 @@ Position Find(ElementType Key, HashTable H);
 void Insert(ElementType Key, HashTable H);
 ElementType Retrieve(Position P, HashTable H);
 HashTable Rehash(HashTable H);
+#ifdef ValueType
+ValueType *FindValue(ElementType Key, HashTable H);
+ValueType *InsertOrAssign(ElementType Key, ValueType Value, HashTable H);
+ValueType *Upsert(ElementType Key, HashTable H);
+#endif
 
 enum KindOfEntry
 {
@@ -464,6 +1557,9 @@ enum KindOfEntry
 struct HashEntry
 {
     ElementType Element;
+#ifdef ValueType
+    ValueType Value;
+#endif
     enum KindOfEntry Info;
 };
 
@@ -479,7 +1575,9 @@ struct HashTbl
 
 #ifdef _BinHeap_H
 
+#ifndef MinData
 #define MinData (INT_MIN)
+#endif
 
 #define MinPQSize (5)
 
@@ -504,19 +1602,97 @@ struct HeapStruct
 
 #endif
 
+#ifdef _RadixHeap_H
+
+#define RadixBuckets ((int)(sizeof(ElementType) * CHAR_BIT + 1))
+#define MinBucketSize (8)
+
+struct RadixBucket;
+struct RadixHeapStruct;
+typedef struct RadixHeapStruct *PriorityQueue;
+
+static void PushBucket(ElementType X, struct RadixBucket *B);
+static int BucketIndex(ElementType X, ElementType Last);
+static void Refill(PriorityQueue H);
+PriorityQueue Initialize(void);
+void Destroy(PriorityQueue H);
+void MakeEmpty(PriorityQueue H);
+void Insert(ElementType X, PriorityQueue H);
+ElementType DeleteMin(PriorityQueue H);
+ElementType FindMin(PriorityQueue H);
+int IsEmpty(PriorityQueue H);
+
+struct RadixBucket
+{
+    int Capacity;
+    int Size;
+    ElementType *Elements;
+};
+
+struct RadixHeapStruct
+{
+    int Size;
+    ElementType Last;
+    struct RadixBucket Buckets[RadixBuckets];
+};
+
+#endif
+
+#ifdef _BucketQueue_H
+
+#define MinBucketSize (8)
+
+struct Bucket;
+struct BucketQueueStruct;
+typedef struct BucketQueueStruct *PriorityQueue;
+
+static void PushBucket(ElementType X, struct Bucket *B);
+PriorityQueue Initialize(int MaxWeight);
+void Destroy(PriorityQueue H);
+void MakeEmpty(PriorityQueue H);
+void Insert(ElementType X, PriorityQueue H);
+ElementType DeleteMin(PriorityQueue H);
+ElementType FindMin(PriorityQueue H);
+int IsEmpty(PriorityQueue H);
+
+struct Bucket
+{
+    int Capacity;
+    int Size;
+    ElementType *Elements;
+};
+
+struct BucketQueueStruct
+{
+    int NumBuckets;
+    int Size;
+    ElementType Last;
+    struct Bucket *Buckets;
+};
+
+#endif
+
 #ifdef _LeftHeap_H
 
 struct TreeNode;
 typedef struct TreeNode *PriorityQueue;
 
+#ifdef _SkewHeap
+static PriorityQueue NewNode(ElementType X, PriorityQueue Left, PriorityQueue Right);
+#else
 static PriorityQueue NewNode(ElementType X, PriorityQueue Left, PriorityQueue Right, int Npl);
-static void DeleteNode(PriorityQueue H);
+static int GetNpl(PriorityQueue H);
 static void SwapChild(PriorityQueue H);
+
+#define MaxRightPath (128)
+#endif
+static void DeleteNode(PriorityQueue H);
 PriorityQueue Initialize(void);
+PriorityQueue MakeEmpty(PriorityQueue H);
 ElementType FindMin(PriorityQueue H);
 int IsEmpty(PriorityQueue H);
 PriorityQueue Merge(PriorityQueue H1, PriorityQueue H2);
-static PriorityQueue Merge1(PriorityQueue H1, PriorityQueue H2);
+PriorityQueue BuildHeap(ElementType A[], int N);
 
 #define Insert(X, H) (H = Insert1((X), H))
 
@@ -528,7 +1704,9 @@ struct TreeNode
     ElementType Element;
     PriorityQueue Left;
     PriorityQueue Right;
+#ifndef _SkewHeap
     int Npl;
+#endif
 };
 
 #endif
@@ -744,30 +1922,79 @@ struct ListRecord
 
 #endif
 
-#ifndef _Splay_H
+#ifdef _Splay_H
+
+#define SplayBlockSize (256)
+#define SplayIteratorInline (64)
 
 struct SplayNode;
-typedef struct SplayNode *SplayTree;
 typedef struct SplayNode *Position;
-#define Infinity 30000
-#define NegInfinity (-30000)
+struct SplayBlock;
+struct SplayTreeRecord;
+typedef struct SplayTreeRecord *SplayTree;
+struct SplayIterator;
+
+static Position NewNode(ElementType X, Position Left, Position Right, SplayTree T);
+static void DeleteNode(Position P, SplayTree T);
+static Position SingleRotateWithLeft(Position K2);
+static Position SingleRotateWithRight(Position K1);
+static Position Splay(ElementType Item, Position X, SplayTree T);
+static int SplayDue(SplayTree T);
 
-Position NewNode(ElementType X, SplayTree Left, SplayTree Right);
-void DeleteNode(Position P);
-SplayTree MakeEmpty(SplayTree T);
-SplayTree Find(ElementType X, SplayTree T);
-SplayTree FindMin(SplayTree T);
-SplayTree FindMax(SplayTree T);
 SplayTree Initialize(void);
+void DisposeTree(SplayTree T);
+SplayTree MakeEmpty(SplayTree T);
+void SetSplayPeriod(int K, SplayTree T);
+int IsEmpty(SplayTree T);
+Position Find(ElementType X, SplayTree T);
+Position FindMin(SplayTree T);
+Position FindMax(SplayTree T);
 SplayTree Insert(ElementType X, SplayTree T);
 SplayTree Remove(ElementType X, SplayTree T);
-ElementType Retrieve(SplayTree T);
+ElementType Retrieve(Position P);
+static void IteratorPush(Position P, struct SplayIterator *I);
+static void PushLeft(Position P, struct SplayIterator *I);
+Position IteratorFirst(SplayTree T, struct SplayIterator *I);
+Position IteratorSeek(ElementType X, SplayTree T, struct SplayIterator *I);
+Position IteratorNext(struct SplayIterator *I);
+void IteratorDispose(struct SplayIterator *I);
+void RangeScan(ElementType Lo, ElementType Hi, void (*Visit)(Position P, void *Arg), void *Arg, SplayTree T);
 
 struct SplayNode
 {
     ElementType Element;
-    SplayTree Left;
-    SplayTree Right;
+    Position Left;
+    Position Right;
+};
+
+struct SplayBlock
+{
+    struct SplayBlock *Next;
+    struct SplayNode Nodes[SplayBlockSize];
 };
 
-#endif
\ No newline at end of file
+// everything Splay touches lives in the tree, so separate trees can be
+// used from separate threads; free nodes are chained through Left
+struct SplayTreeRecord
+{
+    Position Root;
+    struct SplayNode NullNode;
+    struct SplayNode Header;
+    struct SplayBlock *Blocks;
+    int Used;
+    Position FreeList;
+    int SplayPeriod;
+    int Accesses;
+};
+
+// iterating does not splay, so a scan leaves the tree shape alone
+struct SplayIterator
+{
+    Position *Stack;
+    int Top;
+    int Capacity;
+    Position NullNode;
+    Position Inline[SplayIteratorInline];
+};
+
+#endif